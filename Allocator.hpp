@@ -0,0 +1,80 @@
+/**
+ * @file Allocator.hpp
+ * @author Aaryaman Sagar
+ *
+ * An allocator class that lets STL containers get their memory from the
+ * allocator in eecs281malloc.hpp without replacing malloc for the whole
+ * program
+ *
+ *  auto map = std::unordered_map<int, int, std::hash<int>,
+ *      std::equal_to<int>, eecs281::Allocator<std::pair<const int, int>>>{};
+ *
+ * The allocator has no state, so it takes up no space in a container that
+ * stores it as an empty base and any two allocators compare equal.  The
+ * containers pass the number of objects to deallocate(), so the memory is
+ * freed with free_sized() and goes straight into the thread's cache when it
+ * is small.  Types that are aligned to more than std::max_align_t get their
+ * memory from aligned_alloc()
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+
+namespace eecs281 {
+
+template <typename Type>
+class Allocator {
+public:
+
+    /**
+     * These are required by std::allocator_traits, everything else that the
+     * containers need is filled in by the traits
+     */
+    using value_type = Type;
+    using is_always_equal = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    /**
+     * The allocator has no state, an allocator for one type can be made
+     * from an allocator for any other type
+     */
+    constexpr Allocator() noexcept = default;
+    template <typename Other>
+    constexpr Allocator(const Allocator<Other>&) noexcept;
+
+    /**
+     * Allocates memory for number objects and frees the memory of number
+     * objects respectively
+     *
+     * allocate() throws a std::bad_array_new_length exception when the
+     * memory would be larger than max_size() objects and a std::bad_alloc
+     * exception when there is no memory
+     *
+     * @param number the number of objects, the number passed to
+     *        deallocate() must be the one that the memory was allocated for
+     * @param pointer the memory to free
+     */
+    Type* allocate(std::size_t number);
+    void deallocate(Type* pointer, std::size_t number) noexcept;
+
+    /**
+     * Returns the largest number of objects that can be allocated at once
+     */
+    std::size_t max_size() const noexcept;
+};
+
+/**
+ * Every allocator can free the memory of every other one
+ */
+template <typename One, typename Two>
+constexpr bool operator==(const Allocator<One>&, const Allocator<Two>&)
+        noexcept;
+template <typename One, typename Two>
+constexpr bool operator!=(const Allocator<One>&, const Allocator<Two>&)
+        noexcept;
+
+} // namespace eecs281
+
+#include "Allocator.ipp"
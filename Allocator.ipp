@@ -0,0 +1,63 @@
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+#include "Allocator.hpp"
+#include "eecs281malloc.hpp"
+
+namespace eecs281 {
+
+static_assert(std::is_empty<Allocator<int>>::value,
+        "The allocator should take up no space in the containers");
+
+template <typename Type>
+template <typename Other>
+constexpr Allocator<Type>::Allocator(const Allocator<Other>&) noexcept {}
+
+template <typename Type>
+Type* Allocator<Type>::allocate(std::size_t number) {
+    if (number > this->max_size()) {
+        throw std::bad_array_new_length{};
+    }
+
+    // the containers can ask for no objects, the allocator returns memory
+    // that can be freed for that like malloc(3) does
+    auto amount = static_cast<int>(number * sizeof(Type));
+    if (alignof(Type) > alignof(std::max_align_t)) {
+        return static_cast<Type*>(eecs281::aligned_alloc(
+                    static_cast<int>(alignof(Type)), amount));
+    }
+    return static_cast<Type*>(eecs281::malloc(amount));
+}
+
+template <typename Type>
+void Allocator<Type>::deallocate(Type* pointer, std::size_t number) noexcept {
+    // the size of aligned memory is not used, memory of the same size from
+    // malloc() might have come from a different place.  The functions are
+    // qualified since argument dependent lookup can find the ones in std
+    if (alignof(Type) > alignof(std::max_align_t)) {
+        eecs281::free(pointer);
+        return;
+    }
+    eecs281::free_sized(pointer,
+            static_cast<int>(number * sizeof(Type)));
+}
+
+template <typename Type>
+std::size_t Allocator<Type>::max_size() const noexcept {
+    return static_cast<std::size_t>(MAXIMUM_REQUEST) / sizeof(Type);
+}
+
+template <typename One, typename Two>
+constexpr bool operator==(const Allocator<One>&, const Allocator<Two>&)
+        noexcept {
+    return true;
+}
+
+template <typename One, typename Two>
+constexpr bool operator!=(const Allocator<One>&, const Allocator<Two>&)
+        noexcept {
+    return false;
+}
+
+} // namespace eecs281
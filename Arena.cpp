@@ -0,0 +1,887 @@
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <initializer_list>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <utility>
+#include <iostream>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Arena.hpp"
+#include "block.hpp"
+#include "config.hpp"
+#include "os_memory.hpp"
+#include "pagemap.hpp"
+#include "slab.hpp"
+
+using std::uintptr_t;
+using std::max_align_t;
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * The arenas, these are constant initialized so they can be used at any
+     * point in the program.  Only the first number_arenas() of these are
+     * ever used, so the memory for the rest is never touched
+     */
+    Arena arenas[MAXIMUM_ARENAS];
+
+    /**
+     * The number of threads that have been assigned an arena so far, used
+     * to assign arenas round robin
+     */
+    std::atomic<unsigned> number_assigned{0};
+
+    /**
+     * Whether the background purge thread has been started
+     */
+    std::atomic<bool> background_started{false};
+
+    /**
+     * Whether the fork handlers have been registered
+     */
+    std::atomic<bool> fork_handlers_registered{false};
+
+    /**
+     * Returns the length of an epoch of the decay in nanoseconds, the decay
+     * time should be positive
+     */
+    std::int64_t epoch_length();
+
+    /**
+     * Returns the fraction of the pages that became dirty age epochs ago that
+     * an arena is still allowed to keep, this falls from one to zero along
+     * a smoothstep curve as the age goes from zero to NUMBER_DECAY_STEPS
+     */
+    double decay_weight(int age);
+
+    /**
+     * The body of the background purge thread
+     */
+    void* background_purge(void*);
+
+    /**
+     * The fork handlers, every arena is locked before a fork so that no
+     * arena is copied into the child in the middle of an update, and they
+     * are all unlocked after the fork in both the parent and the child.  The
+     * child has none of the parent's other threads, so the background purge
+     * thread has to be started again in the child if it is needed
+     */
+    void lock_before_fork();
+    void unlock_after_fork();
+    void unlock_after_fork_in_child();
+
+    /**
+     * Fetches memory for the heap from the operating system, this is backed
+     * by huge pages when they are enabled in the configuration.  A chunk
+     * holds at least the given amount and a slab segment is exactly
+     * SLAB_SEGMENT_SIZE bytes aligned to its size
+     */
+    std::pair<void*, int> fetch_chunk(int amount);
+    std::pair<void*, int> fetch_slab_segment();
+
+} // namespace <anonymous>
+
+
+int bin_index(int amount) {
+    assert(amount > 0);
+    assert(boundary_aligned(amount));
+
+    // blocks in the exact range map directly to a bin, the rest map to the
+    // bin for the power of two range that they lie in
+    if (amount <= EXACT_BIN_LIMIT) {
+        return amount / static_cast<int>(alignof(max_align_t)) - 1;
+    }
+    auto log = std::numeric_limits<unsigned>::digits - 1
+        - __builtin_clz(static_cast<unsigned>(amount));
+    auto index = NUMBER_EXACT_BINS + log - EXACT_BIN_LIMIT_LOG;
+    assert(index >= NUMBER_EXACT_BINS && index < NUMBER_BINS);
+    return index;
+}
+
+int bin_maximum_size(int index) {
+    assert(index >= 0 && index < NUMBER_BINS);
+    auto alignment = static_cast<int>(alignof(max_align_t));
+    if (index < NUMBER_EXACT_BINS) {
+        return (index + 1) * alignment;
+    }
+    auto log = index - NUMBER_EXACT_BINS + EXACT_BIN_LIMIT_LOG;
+    return static_cast<int>((std::int64_t{1} << (log + 1)) - alignment);
+}
+
+Arena& arena_from_index(int index) {
+    assert(index >= 0 && index < number_arenas());
+    return arenas[index];
+}
+
+int number_arenas() {
+    static const auto number = std::min(config().number_arenas,
+            MAXIMUM_ARENAS);
+    return number;
+}
+
+Arena& assign_arena() {
+    // the handlers are registered when the first thread gets an arena,
+    // which is before any arena can be locked
+    if (!fork_handlers_registered.exchange(true)) {
+        pthread_atfork(lock_before_fork, unlock_after_fork,
+                unlock_after_fork_in_child);
+    }
+
+    auto assigned = number_assigned.fetch_add(1, std::memory_order_relaxed);
+    return arenas[assigned % static_cast<unsigned>(number_arenas())];
+}
+
+void start_background_purge() {
+    if (background_started.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (!config().background_purge || config().decay_time <= 0) {
+        return;
+    }
+    if (background_started.exchange(true)) {
+        return;
+    }
+
+    // the thread is detached and runs for as long as the process does, if
+    // it cannot be created then the arenas are still purged when blocks are
+    // freed to them
+    auto thread = pthread_t{};
+    if (!pthread_create(&thread, nullptr, background_purge, nullptr)) {
+        pthread_detach(thread);
+    }
+}
+
+void Arena::lock() {
+    this->mutex.lock();
+}
+
+void Arena::unlock() {
+    this->mutex.unlock();
+}
+
+void Arena::decay() {
+    auto decay_time = config().decay_time;
+    if (decay_time < 0) {
+        return;
+    }
+    if (!decay_time) {
+        this->purge_down_to(0);
+        return;
+    }
+
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (!this->epoch_start) {
+        this->epoch_start = now;
+        return;
+    }
+    auto epochs = (now - this->epoch_start) / epoch_length();
+    if (!epochs) {
+        return;
+    }
+    this->epoch_start += epochs * epoch_length();
+
+    // age the backlog by the number of epochs that have passed, and record
+    // the pages that became dirty during the epoch that just ended as the
+    // newest entry
+    auto shift = static_cast<int>(std::min<std::int64_t>(epochs,
+                NUMBER_DECAY_STEPS));
+    std::copy_backward(this->backlog,
+            this->backlog + NUMBER_DECAY_STEPS - shift,
+            this->backlog + NUMBER_DECAY_STEPS);
+    std::fill(this->backlog, this->backlog + shift, 0);
+    this->backlog[0] = std::max(this->dirty_pages - this->dirty_at_epoch, 0);
+
+    auto limit = 0.0;
+    for (auto age = 0; age < NUMBER_DECAY_STEPS; ++age) {
+        limit += this->backlog[age] * decay_weight(age);
+    }
+    this->purge_down_to(static_cast<int>(limit));
+    this->dirty_at_epoch = this->dirty_pages;
+}
+
+std::uint64_t Arena::pages_purged() const noexcept {
+    return this->purged;
+}
+
+std::uint64_t Arena::pages_reused() const noexcept {
+    return this->reused;
+}
+
+void Arena::attach(ThreadStatistics* statistics) {
+    statistics->previous = nullptr;
+    statistics->next = this->threads;
+    if (this->threads) {
+        this->threads->previous = statistics;
+    }
+    this->threads = statistics;
+}
+
+void Arena::detach(ThreadStatistics* statistics) {
+    for (auto index = 0; index < NUMBER_BINS; ++index) {
+        this->mallocs[index] += statistics->mallocs[index].load(
+                std::memory_order_relaxed);
+        this->frees[index] += statistics->frees[index].load(
+                std::memory_order_relaxed);
+    }
+
+    if (statistics->previous) {
+        statistics->previous->next = statistics->next;
+    } else {
+        assert(this->threads == statistics);
+        this->threads = statistics->next;
+    }
+    if (statistics->next) {
+        statistics->next->previous = statistics->previous;
+    }
+}
+
+void Arena::count_malloc(int size) {
+    ++this->mallocs[bin_index(size)];
+}
+
+void Arena::count_free(int size) {
+    ++this->frees[bin_index(size)];
+}
+
+void Arena::add_statistics(Statistics& statistics) {
+    statistics.mapped_bytes += this->mapped_bytes;
+    statistics.allocated_bytes += this->allocated_bytes;
+    statistics.free_bytes += this->free_bytes;
+    statistics.free_blocks += this->free_blocks;
+    statistics.pages_purged += this->purged;
+    statistics.pages_reused += this->reused;
+
+    for (auto index = 0; index < NUMBER_BINS; ++index) {
+        auto& size_class = statistics.size_classes[index];
+        size_class.mallocs += this->mallocs[index];
+        size_class.frees += this->frees[index];
+        for (auto thread = this->threads; thread; thread = thread->next) {
+            size_class.mallocs += thread->mallocs[index].load(
+                    std::memory_order_relaxed);
+            size_class.frees += thread->frees[index].load(
+                    std::memory_order_relaxed);
+        }
+    }
+
+    // the largest free block is the last one in the tree, or if the tree
+    // is empty one of the blocks in the highest non empty bin
+    auto largest = 0;
+    if (!this->large_blocks.empty()) {
+        largest = this->large_blocks.last()->datum.size;
+    } else if (this->non_empty_bins) {
+        largest = bin_maximum_size(std::numeric_limits<BinMap_t>::digits - 1
+                - __builtin_clzll(this->non_empty_bins));
+    }
+    statistics.largest_free_block = std::max<std::uint64_t>(
+            statistics.largest_free_block, largest);
+}
+
+int Arena::index() const noexcept {
+    return static_cast<int>(this - arenas);
+}
+
+Header_t* Arena::allocate(int amount) {
+    // look through the bins to see if a block with the right size can be
+    // found
+    auto header_to_return = this->find_fitting_block(amount);
+
+    // memory that other threads have freed to the arena might coalesce into
+    // a block that is large enough, otherwise ask the operating system for
+    // more memory and then use that block, room is left for the header of
+    // the block and for the fence after it
+    if (!header_to_return && this->drain_remote_frees()) {
+        header_to_return = this->find_fitting_block(amount);
+    }
+    if (!header_to_return) {
+        auto chunk = fetch_chunk(amount + 2 * static_cast<int>(
+                    sizeof(Header_t)));
+        map_pages(chunk.first, chunk.second,
+                PageEntry{PageKind::CHUNK, this->index(), nullptr});
+        this->mapped_bytes += chunk.second;
+        header_to_return = this->add_chunk(chunk);
+    }
+
+    // remove the amount of memory that the user had asked for from the
+    // header, if there was more memory left, then reinsert whatever is left
+    // into the bin that it belongs in.  The pages of what is left stay
+    // purged if the block was purged
+    assert(header_to_return->datum.size >= amount);
+    auto was_purged = header_to_return->datum.flags & PURGED;
+    auto was_zeroed = header_to_return->datum.flags & ZEROED;
+    auto new_header = remove_memory(header_to_return, amount);
+    assert(new_header);
+    if (was_purged) {
+        header_to_return->datum.flags &= ~PURGED;
+        this->reused += purgeable_pages(header_to_return);
+    }
+    mark_in_use(header_to_return);
+    if (new_header != header_to_return) {
+        new_header->datum.flags |= was_purged | was_zeroed;
+        mark_free(new_header);
+        this->insert_into_bin(new_header);
+    }
+    this->allocated_bytes += header_to_return->datum.size;
+    return header_to_return;
+}
+
+void Arena::deallocate(Header_t* header_ptr) {
+    assert(header_ptr->datum.flags & IN_USE);
+    assert(header_ptr->datum.arena == this->index());
+    assert(!(header_ptr->datum.flags & SAMPLED) == !header_ptr->datum.sample);
+    this->allocated_bytes -= header_ptr->datum.size;
+
+    // find the neighbours of the block that are free, they are removed from
+    // their bins since the size of the block they get merged into changes
+    auto before = (header_ptr->datum.flags & PREV_IN_USE)
+        ? nullptr : previous_block(header_ptr);
+    auto after = next_block(header_ptr);
+    after = (after->datum.flags & IN_USE) ? nullptr : after;
+
+    // the merged block stays purged if purged neighbours make up most of it,
+    // in which case the rest of it is purged right away, otherwise all of it
+    // is dirty.  So freeing blocks next to a large purged block does not
+    // purge the large block over and over again
+    auto purged_size = 0;
+    auto purged_pages = 0;
+    auto dirty_size = header_ptr->datum.size;
+    for (auto neighbour : {before, after}) {
+        if (neighbour) {
+            this->erase_from_bin(neighbour);
+            if (neighbour->datum.flags & PURGED) {
+                purged_size += neighbour->datum.size;
+                purged_pages += purgeable_pages(neighbour);
+            } else {
+                dirty_size += neighbour->datum.size;
+            }
+        }
+    }
+    auto stays_purged = purged_size > dirty_size;
+
+    // coalesce with the blocks before and after, the second coalesce might
+    // include the coalesced block from the first
+    if (before) {
+        header_ptr = coalesce(before, header_ptr);
+        assert(header_ptr == before);
+    }
+    if (after) {
+        header_ptr = coalesce(header_ptr, after);
+        assert(header_ptr);
+    }
+
+    // update the boundary tags and insert back into the bin that the
+    // resulting block belongs in, the block has been written to so it is
+    // not known to be zero anymore and its sample (if any) has been dropped
+    header_ptr->datum.flags &= ~(ZEROED | SAMPLED | PURGED);
+    header_ptr->datum.sample = nullptr;
+    mark_free(header_ptr);
+
+    // a merged block that stays purged is purged as a whole, which also
+    // covers the pages that straddle the pieces it was merged from.  Only
+    // the pages that were not purged already are counted
+    if (stays_purged) {
+        auto region = purgeable_region(header_ptr);
+        if (region.second && purge_memory(region.first, region.second)) {
+            this->purged += purgeable_pages(header_ptr) - purged_pages;
+        }
+        header_ptr->datum.flags |= PURGED;
+    }
+    this->insert_into_bin(header_ptr);
+
+    // only blocks with whole pages in them add to the dirty pages, so the
+    // clock is not read when small blocks are freed.  With no decay time
+    // the block is purged right away
+    if (!stays_purged && purgeable_pages(header_ptr)) {
+        if (!config().decay_time) {
+            this->purge_block(header_ptr);
+        } else {
+            this->decay();
+        }
+    }
+}
+
+void Arena::allocate_batch(int amount, int count, void** pointers) {
+    assert(amount < config().mmap_threshold);
+    if (amount <= SLAB_LIMIT) {
+        for (auto i = 0; i < count; ++i) {
+            pointers[i] = this->allocate_small(amount);
+        }
+        return;
+    }
+
+    // every block of a group but the last is split off the front of the
+    // group's block as it is, the last one gets whatever the group's block
+    // had beyond what was asked for.  The headers of the blocks that are
+    // split off were counted as allocated memory as part of the group
+    auto stride = amount + static_cast<int>(sizeof(Header_t));
+    auto group_size = std::max(1, config().mmap_threshold / stride);
+    for (auto first = 0; first < count; first += group_size) {
+        auto number = std::min(group_size, count - first);
+        auto header_ptr = this->allocate(number * stride
+                - static_cast<int>(sizeof(Header_t)));
+        auto zeroed = header_ptr->datum.flags & ZEROED;
+        for (auto i = first; i < first + number - 1; ++i) {
+            auto rest = remove_memory(header_ptr, amount);
+            assert(rest && rest != header_ptr);
+            rest->datum.flags = IN_USE | PREV_IN_USE | zeroed;
+            this->allocated_bytes -= sizeof(Header_t);
+            pointers[i] = static_cast<void*>(header_ptr + 1);
+            header_ptr = rest;
+        }
+        pointers[first + number - 1] = static_cast<void*>(header_ptr + 1);
+    }
+}
+
+void Arena::deallocate_batch(void* const* pointers, int count) {
+    auto index = 0;
+    while (index < count) {
+        auto header_ptr = static_cast<Header_t*>(pointers[index++]) - 1;
+        assert(header_ptr->datum.flags & IN_USE);
+
+        // the header of a block that is merged in was never counted as
+        // allocated memory, it is counted now since it is freed as part of
+        // the merged block
+        while (index < count && static_cast<Header_t*>(pointers[index]) - 1
+                == next_block(header_ptr)) {
+            assert(pointers[index - 1] < pointers[index]);
+            auto merged = coalesce(header_ptr, next_block(header_ptr));
+            assert(merged == header_ptr);
+            static_cast<void>(merged);
+            this->allocated_bytes += sizeof(Header_t);
+            ++index;
+        }
+        this->deallocate(header_ptr);
+    }
+}
+
+bool Arena::reallocate(Header_t* header_ptr, int amount) {
+    assert(header_ptr->datum.flags & IN_USE);
+    assert(header_ptr->datum.arena == this->index());
+    auto old_size = header_ptr->datum.size;
+
+    // to grow, take over the block after if it is free and the two blocks
+    // together are large enough, the block after is then part of this block
+    if (header_ptr->datum.size < amount) {
+        auto after = next_block(header_ptr);
+        auto combined = header_ptr->datum.size
+            + static_cast<int>(sizeof(Header_t)) + after->datum.size;
+        if ((after->datum.flags & IN_USE) || combined < amount) {
+            return false;
+        }
+        this->erase_from_bin(after);
+        if (after->datum.flags & PURGED) {
+            this->reused += purgeable_pages(after);
+        }
+        header_ptr = coalesce(header_ptr, after);
+        assert(header_ptr);
+        mark_in_use(header_ptr);
+    }
+
+    // then give back the tail of the block if there is room for a block in
+    // it, the tail is freed like any other block so that it coalesces with
+    // the block after it.  The tail was never counted as allocated on its
+    // own, so it is counted before it is freed
+    auto tail = remove_memory(header_ptr, amount);
+    assert(tail);
+    if (tail != header_ptr) {
+        tail->datum.flags = IN_USE | PREV_IN_USE;
+        this->allocated_bytes += tail->datum.size;
+        this->deallocate(tail);
+    }
+    this->allocated_bytes += header_ptr->datum.size - old_size;
+    return true;
+}
+
+Header_t* Arena::allocate_aligned(int alignment, int amount) {
+    assert(alignment > static_cast<int>(alignof(max_align_t)));
+    assert(!(alignment & (alignment - 1)));
+
+    // the padding before the aligned address is either empty or large
+    // enough to be a block, so allocate enough that an aligned address with
+    // such padding before it is always in the block
+    constexpr auto MINIMUM_PADDING = static_cast<uintptr_t>(
+            sizeof(Header_t) + alignof(max_align_t));
+    auto header_ptr = this->allocate(amount + alignment
+            + static_cast<int>(MINIMUM_PADDING));
+    auto address = reinterpret_cast<uintptr_t>(header_ptr + 1);
+    auto aligned = (address + alignment - 1)
+        & ~static_cast<uintptr_t>(alignment - 1);
+    if (aligned != address && aligned - address < MINIMUM_PADDING) {
+        aligned += alignment;
+    }
+
+    // make a block that starts at the aligned address out of the rest of
+    // the block, and free the padding as a block of its own, it coalesces
+    // with the block before it if that is free
+    if (aligned != address) {
+        auto padding = static_cast<int>(aligned - address);
+        auto aligned_header = make_header(
+                reinterpret_cast<void*>(aligned - sizeof(Header_t)),
+                header_ptr->datum.size - padding
+                + static_cast<int>(sizeof(Header_t)));
+        assert(aligned_header);
+        aligned_header->datum.flags = IN_USE;
+        aligned_header->datum.arena = header_ptr->datum.arena;
+        header_ptr->datum.size = padding - static_cast<int>(sizeof(Header_t));
+        assert(next_block(header_ptr) == aligned_header);
+        this->deallocate(header_ptr);
+        header_ptr = aligned_header;
+
+        // the header of the aligned block was counted as allocated memory
+        // when it was still part of the larger block
+        this->allocated_bytes -= sizeof(Header_t);
+    }
+
+    // and give back the tail
+    auto resized = this->reallocate(header_ptr, amount);
+    assert(resized);
+    static_cast<void>(resized);
+    return header_ptr;
+}
+
+void* Arena::allocate_small(int amount) {
+    auto size_class = slab_class(amount);
+    auto& list = this->slabs[size_class];
+
+    // every slab in the list has a free object, if there are none then
+    // objects that other threads have freed might put a slab back in the
+    // list, and if not then make a new slab for the size class
+    if (list.empty()) {
+        this->drain_remote_frees();
+    }
+    if (list.empty()) {
+        list.push_front(make_slab(this->allocate_slab_page(), size_class,
+                    this->index()));
+    }
+
+    // a slab that becomes full is taken out of the list until one of its
+    // objects is freed
+    auto slab = *list.begin();
+    auto pointer = slab_allocate(slab);
+    this->allocated_bytes += amount;
+    if (!slab->datum.number_free) {
+        list.erase(list.begin());
+    }
+    return pointer;
+}
+
+void Arena::deallocate_small(void* pointer) {
+    auto slab = slab_from_pointer(pointer);
+    assert(slab->datum.arena == this->index());
+    auto& list = this->slabs[slab->datum.size_class];
+
+    // a full slab is not in any list, so put it back in the list now that
+    // it has a free object
+    auto was_full = !slab->datum.number_free;
+    slab_deallocate(slab, pointer);
+    this->allocated_bytes -= slab->datum.object_size;
+    if (was_full) {
+        list.push_front(slab);
+    }
+
+    // an empty slab gives its page back so that it can be used for any size
+    // class, unless it is the only slab of its size class in which case it
+    // is kept to avoid remaking it on the next allocation
+    if (slab->datum.number_free == slab->datum.number_objects) {
+        auto iter = list.begin();
+        auto only_slab = (*iter == slab) && (++iter == list.end());
+        if (!only_slab) {
+            list.erase(list.iterator_to(slab));
+            this->free_slab_pages.push_front(slab);
+        }
+    }
+}
+
+void Arena::free_remote(RemoteFree* first, RemoteFree* last) {
+    // the release publishes the writes to the memory and its links to the
+    // thread that drains the stack
+    auto top = this->remote_frees.load(std::memory_order_relaxed);
+    do {
+        last->next = top;
+    } while (!this->remote_frees.compare_exchange_weak(top, first,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool Arena::drain_remote_frees() {
+    // the whole stack is taken with one exchange, so there is never a node
+    // popped off the top while another thread pushes onto it and the stack
+    // cannot see the same top twice (the ABA problem)
+    if (!this->remote_frees.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    auto node = this->remote_frees.exchange(nullptr,
+            std::memory_order_acquire);
+    auto drained = (node != nullptr);
+    while (node) {
+        auto next = node->next;
+        auto entry = page_entry(node);
+        assert(entry.arena == this->index());
+        if (entry.kind == PageKind::SLAB) {
+            this->deallocate_small(node);
+        } else {
+            assert(entry.kind == PageKind::CHUNK);
+            this->deallocate(reinterpret_cast<Header_t*>(node) - 1);
+        }
+        node = next;
+    }
+    return drained;
+}
+
+Header_t* Arena::add_chunk(std::pair<void*, int> chunk) {
+    auto header_ptr = make_chunk(chunk, this->index());
+    auto start = static_cast<char*>(chunk.first);
+    auto adjacent = start == this->heap_end;
+    this->heap_end = start + chunk.second;
+    if (!adjacent) {
+        return header_ptr;
+    }
+
+    // the fence of the last chunk becomes the header of a block that spans
+    // the new chunk, the header that make_chunk() wrote is zeroed again so
+    // that the new memory is still all zeros
+    auto fence = reinterpret_cast<Header_t*>(start) - 1;
+    assert(!fence->datum.size && (fence->datum.flags & IN_USE));
+    assert(fence->datum.arena == this->index());
+    fence->datum.size = header_ptr->datum.size
+        + static_cast<int>(sizeof(Header_t));
+    std::memset(static_cast<void*>(header_ptr), 0, sizeof(Header_t));
+    fence->datum.flags = (fence->datum.flags & PREV_IN_USE) | ZEROED;
+    header_ptr = fence;
+
+    // and a free block at the end of the last chunk grows into it.  The new
+    // pages have never been touched so they are as good as purged, the
+    // merged block is purged if the free block was
+    if (!(header_ptr->datum.flags & PREV_IN_USE)) {
+        auto before = previous_block(header_ptr);
+        this->erase_from_bin(before);
+        header_ptr = coalesce(before, header_ptr);
+        assert(header_ptr == before);
+        header_ptr->datum.flags &= ~(ZEROED | SAMPLED);
+    }
+    mark_free(header_ptr);
+    return header_ptr;
+}
+
+void* Arena::allocate_slab_page() {
+    if (!this->free_slab_pages.empty()) {
+        auto page = *this->free_slab_pages.begin();
+        this->free_slab_pages.pop_front();
+        return static_cast<void*>(page);
+    }
+
+    if (this->segment_cursor == this->segment_end) {
+        auto segment = fetch_slab_segment();
+        map_pages(segment.first, segment.second,
+                PageEntry{PageKind::SLAB, this->index(), nullptr});
+        this->mapped_bytes += segment.second;
+        this->segment_cursor = static_cast<char*>(segment.first);
+        this->segment_end = this->segment_cursor + segment.second;
+    }
+    auto page = this->segment_cursor;
+    this->segment_cursor += SLAB_SIZE;
+    return static_cast<void*>(page);
+}
+
+void Arena::purge_down_to(int limit) {
+    // blocks in the exact bins are too small to have a whole page in them,
+    // so only the tree is walked, from its largest block down.  Purging a
+    // block does not move it in the tree
+    for (auto header_ptr = this->large_blocks.last(); header_ptr
+            && this->dirty_pages > limit;
+            header_ptr = FreeTree_t::previous(header_ptr)) {
+        if (!(header_ptr->datum.flags & PURGED)) {
+            this->purge_block(header_ptr);
+        }
+    }
+}
+
+void Arena::purge_block(Header_t* header_ptr) {
+    assert(!(header_ptr->datum.flags & (IN_USE | PURGED)));
+    this->dirty_pages -= this->purge_pages(header_ptr);
+    header_ptr->datum.flags |= PURGED;
+}
+
+int Arena::purge_pages(Header_t* header_ptr) {
+    auto region = purgeable_region(header_ptr);
+    if (!region.second) {
+        return 0;
+    }
+    auto pages = purgeable_pages(header_ptr);
+    if (purge_memory(region.first, region.second)) {
+        this->purged += pages;
+    }
+    return pages;
+}
+
+void Arena::insert_into_bin(Header_t* header_ptr) {
+    assert(header_ptr);
+    assert(boundary_aligned(header_ptr));
+    assert(!(header_ptr->datum.flags & IN_USE));
+    auto index = bin_index(header_ptr->datum.size);
+    if (index < NUMBER_EXACT_BINS) {
+        this->bins[index].push_front(header_ptr);
+        this->non_empty_bins |= BinMap_t{1} << index;
+    } else {
+        this->large_blocks.insert(header_ptr);
+    }
+    this->free_bytes += header_ptr->datum.size;
+    ++this->free_blocks;
+    if (!(header_ptr->datum.flags & PURGED)) {
+        this->dirty_pages += purgeable_pages(header_ptr);
+    }
+}
+
+void Arena::erase_from_bin(Header_t* header_ptr) {
+    assert(header_ptr);
+    assert(!(header_ptr->datum.flags & IN_USE));
+    if (!(header_ptr->datum.flags & PURGED)) {
+        this->dirty_pages -= purgeable_pages(header_ptr);
+    }
+    this->free_bytes -= header_ptr->datum.size;
+    --this->free_blocks;
+    auto index = bin_index(header_ptr->datum.size);
+    if (index < NUMBER_EXACT_BINS) {
+        this->bins[index].erase(this->bins[index].iterator_to(header_ptr));
+        if (this->bins[index].empty()) {
+            this->non_empty_bins &= ~(BinMap_t{1} << index);
+        }
+        return;
+    }
+
+    // the links of a block in the tree are written into its memory, which
+    // has to be all zeros again if the block is ZEROED
+    this->large_blocks.erase(header_ptr);
+    if (header_ptr->datum.flags & ZEROED) {
+        std::memset(static_cast<void*>(FreeBlockOrder::hook(header_ptr)), 0,
+                sizeof(TreeHook_t));
+    }
+}
+
+Header_t* Arena::find_fitting_block(int amount) {
+    // every block in the lowest non empty exact bin at or above the request
+    // can serve it and is the best fit among the exact bins, so take the
+    // first one
+    auto index = bin_index(amount);
+    auto candidates = index < NUMBER_EXACT_BINS
+        ? this->non_empty_bins & (~BinMap_t{0} << index) : BinMap_t{0};
+    if (candidates) {
+        index = __builtin_ctzll(candidates);
+        auto header_ptr = *this->bins[index].begin();
+        assert(header_ptr->datum.size >= amount);
+        this->erase_from_bin(header_ptr);
+        return header_ptr;
+    }
+
+    // otherwise the smallest block in the tree that is large enough is the
+    // best fit
+    auto header_ptr = this->large_blocks.find_first([amount](auto block) {
+        return block->datum.size >= amount;
+    });
+    if (!header_ptr) {
+        return nullptr;
+    }
+    this->erase_from_bin(header_ptr);
+    return header_ptr;
+}
+
+void Arena::print_free_list() {
+    using std::cout;
+    using std::endl;
+    for (auto index = 0; index < NUMBER_EXACT_BINS; ++index) {
+        for (const auto& node : this->bins[index]) {
+            cout << index << " " << reinterpret_cast<uintptr_t>(node) << " "
+                 << node->datum.size << endl;
+        }
+    }
+    for (auto node = this->large_blocks.first(); node;
+            node = FreeTree_t::next(node)) {
+        cout << bin_index(node->datum.size) << " "
+             << reinterpret_cast<uintptr_t>(node) << " " << node->datum.size
+             << endl;
+    }
+    cout << endl;
+}
+
+namespace {
+
+    std::int64_t epoch_length() {
+        assert(config().decay_time > 0);
+        return std::int64_t{config().decay_time} * 1000000
+            / NUMBER_DECAY_STEPS;
+    }
+
+    double decay_weight(int age) {
+        auto x = static_cast<double>(age + 1) / NUMBER_DECAY_STEPS;
+        return 1.0 - x * x * (3.0 - 2.0 * x);
+    }
+
+    std::pair<void*, int> fetch_chunk(int amount) {
+        // with huge pages the remainder of the chunk goes into the bins and
+        // is used for the following requests, so the heap fills one huge
+        // page before it touches the next
+        if (config().huge_pages == HugePages::NONE) {
+            return extend_heap_reserved(amount, getpagesize());
+        }
+        return extend_heap_huge(amount,
+                config().huge_pages == HugePages::EXPLICIT);
+    }
+
+    std::pair<void*, int> fetch_slab_segment() {
+        // slab pages are carved out of a segment in address order, so small
+        // objects are packed into one huge page before the next is used
+        static_assert(SLAB_SEGMENT_SIZE == HUGE_PAGE_SIZE,
+                "A slab segment should be exactly one huge page");
+        if (config().huge_pages == HugePages::NONE) {
+            return extend_heap_reserved(SLAB_SEGMENT_SIZE, SLAB_SEGMENT_SIZE);
+        }
+        return extend_heap_huge(SLAB_SEGMENT_SIZE,
+                config().huge_pages == HugePages::EXPLICIT);
+    }
+
+    void lock_before_fork() {
+        for (auto index = 0; index < number_arenas(); ++index) {
+            arenas[index].lock();
+        }
+    }
+
+    void unlock_after_fork() {
+        for (auto index = number_arenas() - 1; index >= 0; --index) {
+            arenas[index].unlock();
+        }
+    }
+
+    void unlock_after_fork_in_child() {
+        background_started.store(false);
+        unlock_after_fork();
+    }
+
+    void* background_purge(void*) {
+        auto length = epoch_length();
+        auto interval = timespec{};
+        interval.tv_sec = static_cast<time_t>(length / 1000000000);
+        interval.tv_nsec = static_cast<long>(length % 1000000000);
+        for (;;) {
+            nanosleep(&interval, nullptr);
+            for (auto index = 0; index < number_arenas(); ++index) {
+                auto& arena = arenas[index];
+                std::lock_guard<Arena> lock{arena};
+                arena.drain_remote_frees();
+                arena.decay();
+            }
+        }
+        return nullptr;
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
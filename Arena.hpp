@@ -0,0 +1,506 @@
+/**
+ * @file Arena.hpp
+ * @author Aaryaman Sagar
+ *
+ * An arena is an independent heap, it has its own lock, its own free blocks
+ * and its own chunks of memory from the operating system.  Threads are
+ * spread across a number of arenas so that threads that allocate heavily do
+ * not all contend on one lock and do not share the cache lines of one set of
+ * free lists.  A block always belongs to the arena that it was carved out
+ * of (this is recorded in its boundary tag) and is freed back into that
+ * arena no matter which thread frees it.  Small objects are served from
+ * slabs that the arena carves out of its own slab segments, a slab likewise
+ * always belongs to one arena
+ *
+ * None of the methods that work on the free blocks of an arena lock the
+ * arena themselves, the arena is a BasicLockable so the caller should hold
+ * a std::lock_guard (or similar) on the arena for as long as it uses it.
+ * This way a caller can do a batch of work while locking the arena only once
+ *
+ * Memory that a thread frees to an arena other than its own does not take
+ * that arena's lock.  It is pushed onto the arena's remote free stack with a
+ * single compare and swap, linked through the memory itself, and whichever
+ * thread next misses while allocating from the arena takes the whole stack
+ * at once and frees it under the lock it already holds.  So a thread that
+ * only frees what other threads allocate never waits on their lock
+ *
+ * The whole pages inside the free blocks of an arena are dirty until they
+ * are purged back to the operating system.  Every arena keeps a count of
+ * its dirty pages and a backlog of how many pages became dirty in each of
+ * the last NUMBER_DECAY_STEPS epochs (an epoch is the decay time divided by
+ * the number of steps).  The number of dirty pages that the arena is allowed
+ * to keep is the backlog weighted by a smoothstep curve that falls from one
+ * to zero over the decay time, so a burst of freed memory is purged a little
+ * at a time rather than all at once, and all of it is purged once the decay
+ * time has passed.  Pages are purged from the largest free blocks first
+ *
+ * Every arena also keeps the counters that the statistics in statistics.hpp
+ * are made of, and a list of the per thread counters of the threads that
+ * are assigned to it so that these can be read without stopping the threads
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+
+#include "block.hpp"
+#include "slab.hpp"
+#include "statistics.hpp"
+
+namespace eecs281 {
+
+/**
+ * The free blocks are segregated by their size so that a block that can
+ * serve a request can be found without walking every free block on the
+ * heap.  The first NUMBER_EXACT_BINS bins each hold blocks of exactly one
+ * size (one bin per multiple of the maximum alignment up to and including
+ * EXACT_BIN_LIMIT).  Larger free blocks are kept in a tree ordered by size
+ * and address rather than in bins, the bins after the exact ones are the
+ * ranges of sizes [2^k, 2^(k + 1)) for increasing values of k and are only
+ * used as the size classes that allocations are counted in
+ */
+constexpr auto NUMBER_EXACT_BINS = 32;
+constexpr auto EXACT_BIN_LIMIT = static_cast<int>(
+        NUMBER_EXACT_BINS * alignof(std::max_align_t));
+constexpr auto EXACT_BIN_LIMIT_LOG = 9;
+constexpr auto NUMBER_BINS = NUMBER_EXACT_BINS
+    + std::numeric_limits<int>::digits - EXACT_BIN_LIMIT_LOG;
+static_assert((1 << EXACT_BIN_LIMIT_LOG) == EXACT_BIN_LIMIT,
+        "The first range bin must start right after the exact bins");
+static_assert(NUMBER_BINS == NUMBER_SIZE_CLASSES,
+        "Allocations are counted in one size class per bin");
+static_assert(sizeof(TreeHook_t) + sizeof(int) <= EXACT_BIN_LIMIT,
+        "A block in the tree must have room for its links and its footer");
+
+/**
+ * The maximum number of arenas, the number of arenas that is configured is
+ * clamped to this
+ */
+constexpr auto MAXIMUM_ARENAS = 256;
+static_assert(MAXIMUM_ARENAS - 1 <= std::numeric_limits<
+        decltype(BlockMetadata::arena)>::max(),
+        "The boundary tag cannot hold the index of every arena");
+
+/**
+ * The size of a cache line, arenas are aligned to this so that two arenas
+ * never share a cache line
+ */
+constexpr auto CACHE_LINE_SIZE = 64;
+
+/**
+ * The number of epochs that the decay time is split into
+ */
+constexpr auto NUMBER_DECAY_STEPS = 20;
+
+/**
+ * Returns the index of the bin that a free block of the given size belongs
+ * in
+ *
+ * @param amount the size of the free block, this should be a positive
+ *        multiple of the maximum alignment on the system
+ *
+ * @return the bin index, in the range [0, NUMBER_BINS)
+ */
+int bin_index(int amount);
+
+/**
+ * Returns the largest block size that belongs in the bin with the given
+ * index, this is the inverse of bin_index() above
+ *
+ * @param index the bin index, in the range [0, NUMBER_BINS)
+ *
+ * @return the largest multiple of the maximum alignment on the system that
+ *         maps to the bin
+ */
+int bin_maximum_size(int index);
+
+/**
+ * The number of allocations and frees in each size class that one thread
+ * has made without going through an arena.  Only the thread itself writes
+ * its counters, with a relaxed load and store rather than an atomic
+ * increment so that counting costs no more than a plain increment, and the
+ * counters are read by whoever takes a snapshot of the statistics.  The
+ * counters of a thread are linked into the list of the arena that the
+ * thread is assigned to, this list is protected by the arena's lock
+ */
+struct ThreadStatistics {
+    std::atomic<std::uint64_t> mallocs[NUMBER_BINS];
+    std::atomic<std::uint64_t> frees[NUMBER_BINS];
+    ThreadStatistics* previous;
+    ThreadStatistics* next;
+};
+
+/**
+ * A piece of memory on the remote free stack of an arena, the link is
+ * written over the first bytes of the memory like the links of the thread
+ * caches.  The memory stays marked as in use until the arena frees it
+ */
+struct RemoteFree {
+    RemoteFree* next;
+};
+
+class alignas(CACHE_LINE_SIZE) Arena {
+public:
+
+    /**
+     * Constructs an arena with no memory in it, the arena fetches memory
+     * from the operating system the first time that it needs it.  This is
+     * constexpr so that the arenas are constant initialized, and can be
+     * used before any dynamic initialization in the program has run
+     */
+    constexpr Arena() noexcept;
+
+    /**
+     * Lock and unlock the arena, these make the arena a BasicLockable
+     */
+    void lock();
+    void unlock();
+
+    /**
+     * Allocate a block from the arena and free a block back to the arena,
+     * these must be called with the arena locked
+     *
+     * @param amount the size of the block to allocate, this should be a
+     *        multiple of the maximum alignment on the system
+     * @param header_ptr the header of the block to be freed, it should
+     *        belong to this arena
+     *
+     * @return the header of a block marked as in use with at least amount
+     *         bytes after it, the block is marked as ZEROED if its memory
+     *         is known to be all zeros apart from its footer slot
+     */
+    Header_t* allocate(int amount);
+    void deallocate(Header_t* header_ptr);
+
+    /**
+     * Allocate count pieces of memory of amount bytes each and free a batch
+     * of blocks respectively, these must be called with the arena locked.
+     * Small objects come from the slabs one after the other.  Blocks are
+     * carved out of one larger block for as many of them as fit below the
+     * mmap threshold, so the bins are searched and the remainder is put
+     * back once per group of blocks rather than once per block
+     *
+     * The blocks that are freed must be sorted by address.  A run of blocks
+     * that are right next to each other in memory is merged into one while
+     * it is still in use and then freed as a single block, so the run is
+     * coalesced with its free neighbours and put into a bin once
+     *
+     * @param amount the size of the memory to allocate, this should be a
+     *        multiple of the maximum alignment on the system that is below
+     *        the mmap threshold
+     * @param count the number of pieces of memory to allocate or free
+     * @param pointers the array that the allocated memory is written to, or
+     *        the memory of the blocks to be freed, they should all belong to
+     *        this arena
+     */
+    void allocate_batch(int amount, int count, void** pointers);
+    void deallocate_batch(void* const* pointers, int count);
+
+    /**
+     * Resizes an in use block of the arena in place, this must be called
+     * with the arena locked.  A block shrinks by splitting off its tail and
+     * freeing the tail, and a block grows by merging with the block right
+     * after it when that block is free and large enough (and then splitting
+     * off what it does not need)
+     *
+     * @param header_ptr the header of the block to resize, it should belong
+     *        to this arena
+     * @param amount the new size of the block, this should be a multiple of
+     *        the maximum alignment on the system
+     *
+     * @return true if the block now has at least amount bytes, false if it
+     *         could not be grown in place in which case it is left alone
+     */
+    bool reallocate(Header_t* header_ptr, int amount);
+
+    /**
+     * Allocate a block whose memory is aligned to more than the maximum
+     * alignment on the system, this must be called with the arena locked.
+     * A larger block is allocated, the padding before the aligned address
+     * is split off and freed as a block of its own and so is the tail
+     *
+     * @param alignment the alignment, a power of two larger than the
+     *        maximum alignment on the system
+     * @param amount the size of the block, this should be a multiple of the
+     *        maximum alignment on the system
+     *
+     * @return the header of a block marked as in use with at least amount
+     *         bytes after it, the memory after the header is aligned
+     */
+    Header_t* allocate_aligned(int alignment, int amount);
+
+    /**
+     * Allocate a small object from one of the arena's slabs and free a small
+     * object back to its slab, these must be called with the arena locked
+     *
+     * @param amount the size of the object to allocate, this should be a
+     *        multiple of the maximum alignment on the system that is at most
+     *        SLAB_LIMIT
+     * @param pointer the object to be freed, it should belong to a slab of
+     *        this arena
+     *
+     * @return an object of exactly amount bytes with no header
+     */
+    void* allocate_small(int amount);
+    void deallocate_small(void* pointer);
+
+    /**
+     * Pushes a chain of memory that belongs to this arena onto its remote
+     * free stack, this does not need the arena to be locked and costs one
+     * compare and swap for the whole chain however long it is
+     *
+     * @param first the first piece of memory in the chain, the chain is
+     *        linked through the next pointers up to the last piece
+     * @param last the last piece of memory in the chain, its next pointer
+     *        is overwritten
+     */
+    void free_remote(RemoteFree* first, RemoteFree* last);
+
+    /**
+     * Takes everything off the remote free stack and frees it to the arena,
+     * this must be called with the arena locked.  The arena does this on its
+     * own whenever an allocation misses the free blocks or the slabs, the
+     * background purge thread does it before every decay and a snapshot of
+     * the statistics does it so that the memory is counted as free
+     *
+     * @return true if anything was freed
+     */
+    bool drain_remote_frees();
+
+    /**
+     * Advances the decay of the arena's dirty pages to the current time and
+     * purges as many pages as the decay curve calls for, this must be
+     * called with the arena locked
+     */
+    void decay();
+
+    /**
+     * Returns the number of pages that the arena has purged and the number
+     * of purged pages that were handed out again afterwards respectively,
+     * these must be called with the arena locked
+     */
+    std::uint64_t pages_purged() const noexcept;
+    std::uint64_t pages_reused() const noexcept;
+
+    /**
+     * Links the counters of a thread into the arena and unlinks them
+     * respectively, the counts of a thread that is unlinked are added to the
+     * arena's own counts.  These must be called with the arena locked
+     */
+    void attach(ThreadStatistics* statistics);
+    void detach(ThreadStatistics* statistics);
+
+    /**
+     * Counts an allocation and a free of memory of the given size for a
+     * thread that has no counters of its own linked into an arena, these
+     * must be called with the arena locked
+     *
+     * @param size the usable size of the memory
+     */
+    void count_malloc(int size);
+    void count_free(int size);
+
+    /**
+     * Adds the arena's counters and the counters of the threads linked into
+     * it to the statistics, this must be called with the arena locked.  The
+     * size of the largest free block is the only thing that is not a
+     * counter, it is the last block in the tree of large blocks or the
+     * size of the highest non empty exact bin
+     */
+    void add_statistics(Statistics& statistics);
+
+    /**
+     * Returns the index of the arena, this is what is stored in the boundary
+     * tag of every block that belongs to this arena
+     */
+    int index() const noexcept;
+
+    /**
+     * Prints the free lists, this is a debugging method.  Use this to print
+     * the entire contents of every non empty bin and of the tree of large
+     * blocks, in order of size
+     */
+    void print_free_list();
+
+private:
+
+    /**
+     * A bitmap with one bit for every exact bin, a bit is set if and only if
+     * the corresponding bin has at least one free block in it.  This is used
+     * to find the next non empty bin with a single find-first-set
+     * instruction
+     */
+    using BinMap_t = std::uint64_t;
+    static_assert(NUMBER_EXACT_BINS <= std::numeric_limits<BinMap_t>::digits,
+            "The bin bitmap is not wide enough to hold a bit for each bin");
+
+    /**
+     * Inserts the free block into the exact bin that corresponds to its size
+     * or into the tree of large blocks, and removes a free block from its
+     * bin or from the tree respectively.  Both keep the non empty bins
+     * bitmap up to date
+     */
+    void insert_into_bin(Header_t* header_ptr);
+    void erase_from_bin(Header_t* header_ptr);
+
+    /**
+     * Finds a free block that has at least amount bytes in it, removes it
+     * from the bins and returns it.  If there is no such block then this
+     * returns a nullptr
+     *
+     * An exact bin either has a block of the right size at the front or is
+     * empty, and every block in a higher exact bin is large enough, so the
+     * lowest non empty bin at or above the request is found through the
+     * bitmap and its first block is used.  Requests that are larger than
+     * every exact bin (or that no exact bin can serve) are served best fit
+     * from the tree of large blocks in O(log n) time, with the lowest
+     * address breaking ties between blocks of the same size
+     *
+     * @param amount the size of the request, this should be a multiple of
+     *        the maximum alignment on the system
+     *
+     * @return a pointer to the header of a free block that has been removed
+     *         from the bins or a nullptr if nothing on the heap fits
+     */
+    Header_t* find_fitting_block(int amount);
+
+    /**
+     * Returns an unused slab sized page, pages are taken from the list of
+     * pages of slabs that have become empty before a new page is carved out
+     * of the current slab segment, and a new segment is fetched from the
+     * operating system when the current one is used up
+     */
+    void* allocate_slab_page();
+
+    /**
+     * Turns a chunk of memory fetched from the operating system into a free
+     * block that is in no bin and returns it.  A chunk that starts where the
+     * last chunk of the arena ends is merged into it, the fence of the last
+     * chunk is reused as the header of the new block and a free block at the
+     * end of the last chunk is coalesced with it
+     */
+    Header_t* add_chunk(std::pair<void*, int> chunk);
+
+    /**
+     * Purges free blocks, largest first, until the arena has at most limit
+     * dirty pages, and purges the whole pages of a single free block
+     * respectively.  These keep the dirty page count up to date
+     */
+    void purge_down_to(int limit);
+    void purge_block(Header_t* header_ptr);
+
+    /**
+     * Purges the whole pages of a block that is in no bin and returns the
+     * number of pages purged, this leaves the flags of the block and the
+     * dirty page count alone
+     */
+    int purge_pages(Header_t* header_ptr);
+
+    /**
+     * The free blocks of the arena and the lock that protects them
+     */
+    FreeList_t bins[NUMBER_EXACT_BINS];
+    BinMap_t non_empty_bins;
+    FreeTree_t large_blocks;
+    std::mutex mutex;
+
+    /**
+     * The slabs of the arena.  Each size class has a list of the slabs that
+     * have at least one free object (full slabs are in no list), slabs that
+     * become empty are put in the list of free slab pages so that the page
+     * can be reused for any size class.  The unused part of the current slab
+     * segment lies between the cursor and the end
+     */
+    SlabList_t slabs[NUMBER_SLAB_CLASSES];
+    SlabList_t free_slab_pages;
+    char* segment_cursor;
+    char* segment_end;
+
+    /**
+     * The end of the last chunk that the arena fetched, a chunk that starts
+     * here is merged into it
+     */
+    char* heap_end;
+
+    /**
+     * The state of the decay, the number of whole pages in free blocks that
+     * have not been purged, the number of dirty pages at the start of the
+     * current epoch, the time at which the current epoch started (in
+     * nanoseconds on the steady clock, 0 before the first epoch) and the
+     * number of pages that became dirty in each of the past epochs, newest
+     * first
+     */
+    int dirty_pages;
+    int dirty_at_epoch;
+    std::int64_t epoch_start;
+    int backlog[NUMBER_DECAY_STEPS];
+
+    /**
+     * The number of pages purged and the number of purged pages reused
+     */
+    std::uint64_t purged;
+    std::uint64_t reused;
+
+    /**
+     * The counters for the statistics, the number of bytes that the arena
+     * has mapped from the operating system, the number of usable bytes in
+     * its blocks and slab objects that are in use, the number of bytes and
+     * blocks in its bins, the allocations and frees counted by the arena
+     * itself in each size class and the list of the counters of the threads
+     * assigned to the arena
+     */
+    std::uint64_t mapped_bytes;
+    std::uint64_t allocated_bytes;
+    std::uint64_t free_bytes;
+    std::uint64_t free_blocks;
+    std::uint64_t mallocs[NUMBER_BINS];
+    std::uint64_t frees[NUMBER_BINS];
+    ThreadStatistics* threads;
+
+    /**
+     * The top of the remote free stack, this is the only part of the arena
+     * that other threads write to without the lock so it sits on a cache
+     * line of its own
+     */
+    alignas(CACHE_LINE_SIZE) std::atomic<RemoteFree*> remote_frees;
+};
+
+/**
+ * Returns the arena with the given index, the index should be in the range
+ * [0, number_arenas())
+ */
+Arena& arena_from_index(int index);
+
+/**
+ * Returns the number of arenas in use, this is the configured number of
+ * arenas clamped to MAXIMUM_ARENAS
+ */
+int number_arenas();
+
+/**
+ * Picks an arena for a new thread, threads are assigned to the arenas round
+ * robin in the order that they first allocate memory
+ */
+Arena& assign_arena();
+
+/**
+ * Starts the background thread that decays every arena once per epoch, if
+ * it is enabled in the configuration.  Only the first call does anything,
+ * this should not be called with any arena locked since creating a thread
+ * can allocate memory
+ */
+void start_background_purge();
+
+constexpr Arena::Arena() noexcept
+        : bins{}, non_empty_bins{0}, large_blocks{}, mutex{}, slabs{},
+        free_slab_pages{}, segment_cursor{nullptr}, segment_end{nullptr},
+        heap_end{nullptr}, dirty_pages{0}, dirty_at_epoch{0}, epoch_start{0},
+        backlog{}, purged{0}, reused{0}, mapped_bytes{0}, allocated_bytes{0},
+        free_bytes{0}, free_blocks{0}, mallocs{}, frees{}, threads{nullptr},
+        remote_frees{nullptr} {}
+
+} // namespace eecs281
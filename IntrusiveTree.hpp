@@ -0,0 +1,150 @@
+/**
+ * @file IntrusiveTree.hpp
+ * @author Aaryaman Sagar
+ *
+ * A red-black tree whose links live inside the objects that are in it, in
+ * the same spirit as TransparentList.  The tree never allocates memory, the
+ * user hands it objects that already contain a hook (the left, right and
+ * parent links and the color), so it can be used to keep track of memory
+ * inside an allocator.  Insertion, removal and finding the first object
+ * that satisfies a monotone predicate all take O(log n) time
+ *
+ * The objects do not have to contain the hook as a member, the traits of
+ * the tree say where the hook of an object is and how two objects are
+ * ordered.  This lets the allocator keep the hook of a free block in the
+ * block's memory rather than in its header
+ *
+ *  struct Traits {
+ *      static IntrusiveTreeHook<Node>* hook(Node* node);
+ *      static bool before(const Node* one, const Node* two);
+ *  };
+ *
+ * before() must be a strict weak ordering, objects that are equivalent are
+ * kept in the order that they were inserted in
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+
+namespace eecs281 {
+
+/**
+ * Forward declaration for the tree class
+ */
+template <typename Node, typename Traits>
+class IntrusiveTree;
+
+/**
+ * The links of an object in a tree, an object can only be in one tree at a
+ * time per hook that it has
+ */
+template <typename Node>
+class alignas(alignof(std::max_align_t)) IntrusiveTreeHook {
+public:
+
+    /**
+     * Make the tree class a friend so that it can access the links
+     */
+    template <typename, typename>
+    friend class IntrusiveTree;
+
+private:
+    Node* parent;
+    Node* left;
+    Node* right;
+    bool red;
+};
+
+template <typename Node, typename Traits>
+class IntrusiveTree {
+public:
+
+    /**
+     * A default constructor that initializes the tree to be empty, this is
+     * constexpr so that trees with static storage duration are constant
+     * initialized
+     */
+    constexpr IntrusiveTree() noexcept;
+
+    /**
+     * Inserts a node into the tree and removes a node from the tree
+     * respectively, the node being removed must be in the tree
+     */
+    void insert(Node* node) noexcept;
+    void erase(Node* node) noexcept;
+
+    /**
+     * Returns the first node in order for which the predicate is true, or a
+     * nullptr if there is none.  The predicate has to be false for some
+     * prefix of the nodes in order and true for all the nodes after that,
+     * for example "the node is at least this large"
+     */
+    template <typename Predicate>
+    Node* find_first(Predicate predicate) const noexcept;
+
+    /**
+     * Return the first and the last node in order respectively, these are
+     * nullptr if the tree is empty
+     */
+    Node* first() const noexcept;
+    Node* last() const noexcept;
+
+    /**
+     * Return the node right after and right before a node in order
+     * respectively, these are nullptr at either end of the tree
+     */
+    static Node* next(Node* node) noexcept;
+    static Node* previous(Node* node) noexcept;
+
+    /**
+     * Returns true if there are no nodes in the tree
+     */
+    bool empty() const noexcept;
+
+private:
+
+    /**
+     * Returns the hook of a node, the color of a nullptr is black
+     */
+    static IntrusiveTreeHook<Node>& links(Node* node) noexcept;
+    static bool is_red(Node* node) noexcept;
+
+    /**
+     * Return the first and last node of a subtree
+     */
+    static Node* minimum(Node* node) noexcept;
+    static Node* maximum(Node* node) noexcept;
+
+    /**
+     * Rotate the subtree rooted at the node to the left and to the right
+     * respectively, the child of the node on the other side takes its place
+     */
+    void rotate_left(Node* node) noexcept;
+    void rotate_right(Node* node) noexcept;
+
+    /**
+     * Puts the replacement in the place of the node in the node's parent
+     * (or at the root), this does not change the children of either
+     */
+    void replace(Node* node, Node* replacement) noexcept;
+
+    /**
+     * Restore the colors of the tree after a red node is inserted and after
+     * a black node is removed respectively.  A removed node can leave a
+     * nullptr in its place, so the parent of what took its place is passed
+     * along with it
+     */
+    void fix_after_insert(Node* node) noexcept;
+    void fix_after_erase(Node* node, Node* parent) noexcept;
+
+    /**
+     * The root is the only bookkeeping in the tree
+     */
+    Node* root;
+};
+
+} // namespace eecs281
+
+#include "IntrusiveTree.ipp"
@@ -0,0 +1,324 @@
+#include <cassert>
+
+#include "IntrusiveTree.hpp"
+
+namespace eecs281 {
+
+template <typename Node, typename Traits>
+constexpr IntrusiveTree<Node, Traits>::IntrusiveTree() noexcept
+        : root{nullptr} {}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::insert(Node* node) noexcept {
+    assert(node);
+
+    // walk down to the leaf that the node belongs under, equivalent nodes
+    // go to the right so that they stay in the order they were inserted in
+    auto parent = static_cast<Node*>(nullptr);
+    auto current = this->root;
+    auto goes_left = false;
+    while (current) {
+        parent = current;
+        goes_left = Traits::before(node, current);
+        current = goes_left ? links(current).left : links(current).right;
+    }
+
+    auto& hook = links(node);
+    hook.parent = parent;
+    hook.left = nullptr;
+    hook.right = nullptr;
+    hook.red = true;
+    if (!parent) {
+        this->root = node;
+    } else if (goes_left) {
+        links(parent).left = node;
+    } else {
+        links(parent).right = node;
+    }
+    this->fix_after_insert(node);
+}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::erase(Node* node) noexcept {
+    assert(node);
+
+    // the node is replaced by its only child, or if it has two children by
+    // the first node of its right subtree, which has no left child and is
+    // first moved out of its own place.  What matters for the colors is the
+    // color that goes missing from the place that was vacated and the node
+    // that fills that place
+    auto removed_red = links(node).red;
+    auto filler = static_cast<Node*>(nullptr);
+    auto filler_parent = static_cast<Node*>(nullptr);
+    if (!links(node).left || !links(node).right) {
+        filler = links(node).left ? links(node).left : links(node).right;
+        filler_parent = links(node).parent;
+        this->replace(node, filler);
+        if (filler) {
+            links(filler).parent = filler_parent;
+        }
+    } else {
+        auto successor = minimum(links(node).right);
+        removed_red = links(successor).red;
+        filler = links(successor).right;
+        if (links(successor).parent == node) {
+            filler_parent = successor;
+        } else {
+            filler_parent = links(successor).parent;
+            this->replace(successor, filler);
+            if (filler) {
+                links(filler).parent = filler_parent;
+            }
+            links(successor).right = links(node).right;
+            links(links(successor).right).parent = successor;
+        }
+        this->replace(node, successor);
+        links(successor).parent = links(node).parent;
+        links(successor).left = links(node).left;
+        links(links(successor).left).parent = successor;
+        links(successor).red = links(node).red;
+    }
+
+    if (!removed_red) {
+        this->fix_after_erase(filler, filler_parent);
+    }
+}
+
+template <typename Node, typename Traits>
+template <typename Predicate>
+Node* IntrusiveTree<Node, Traits>::find_first(Predicate predicate) const
+        noexcept {
+    auto found = static_cast<Node*>(nullptr);
+    auto current = this->root;
+    while (current) {
+        if (predicate(current)) {
+            found = current;
+            current = links(current).left;
+        } else {
+            current = links(current).right;
+        }
+    }
+    return found;
+}
+
+template <typename Node, typename Traits>
+Node* IntrusiveTree<Node, Traits>::first() const noexcept {
+    return this->root ? minimum(this->root) : nullptr;
+}
+
+template <typename Node, typename Traits>
+Node* IntrusiveTree<Node, Traits>::last() const noexcept {
+    return this->root ? maximum(this->root) : nullptr;
+}
+
+template <typename Node, typename Traits>
+Node* IntrusiveTree<Node, Traits>::next(Node* node) noexcept {
+    if (links(node).right) {
+        return minimum(links(node).right);
+    }
+    auto parent = links(node).parent;
+    while (parent && node == links(parent).right) {
+        node = parent;
+        parent = links(parent).parent;
+    }
+    return parent;
+}
+
+template <typename Node, typename Traits>
+Node* IntrusiveTree<Node, Traits>::previous(Node* node) noexcept {
+    if (links(node).left) {
+        return maximum(links(node).left);
+    }
+    auto parent = links(node).parent;
+    while (parent && node == links(parent).left) {
+        node = parent;
+        parent = links(parent).parent;
+    }
+    return parent;
+}
+
+template <typename Node, typename Traits>
+bool IntrusiveTree<Node, Traits>::empty() const noexcept {
+    return !this->root;
+}
+
+template <typename Node, typename Traits>
+IntrusiveTreeHook<Node>& IntrusiveTree<Node, Traits>::links(Node* node)
+        noexcept {
+    assert(node);
+    return *Traits::hook(node);
+}
+
+template <typename Node, typename Traits>
+bool IntrusiveTree<Node, Traits>::is_red(Node* node) noexcept {
+    return node && links(node).red;
+}
+
+template <typename Node, typename Traits>
+Node* IntrusiveTree<Node, Traits>::minimum(Node* node) noexcept {
+    while (links(node).left) {
+        node = links(node).left;
+    }
+    return node;
+}
+
+template <typename Node, typename Traits>
+Node* IntrusiveTree<Node, Traits>::maximum(Node* node) noexcept {
+    while (links(node).right) {
+        node = links(node).right;
+    }
+    return node;
+}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::rotate_left(Node* node) noexcept {
+    auto child = links(node).right;
+    assert(child);
+    links(node).right = links(child).left;
+    if (links(child).left) {
+        links(links(child).left).parent = node;
+    }
+    this->replace(node, child);
+    links(child).parent = links(node).parent;
+    links(child).left = node;
+    links(node).parent = child;
+}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::rotate_right(Node* node) noexcept {
+    auto child = links(node).left;
+    assert(child);
+    links(node).left = links(child).right;
+    if (links(child).right) {
+        links(links(child).right).parent = node;
+    }
+    this->replace(node, child);
+    links(child).parent = links(node).parent;
+    links(child).right = node;
+    links(node).parent = child;
+}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::replace(Node* node, Node* replacement)
+        noexcept {
+    auto parent = links(node).parent;
+    if (!parent) {
+        this->root = replacement;
+    } else if (links(parent).left == node) {
+        links(parent).left = replacement;
+    } else {
+        links(parent).right = replacement;
+    }
+}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::fix_after_insert(Node* node) noexcept {
+    // a red node with a red parent is the only thing that can be wrong, the
+    // parent is not the root (the root is black) so there is a grandparent
+    while (is_red(links(node).parent)) {
+        auto parent = links(node).parent;
+        auto grandparent = links(parent).parent;
+        auto parent_is_left = (parent == links(grandparent).left);
+        auto uncle = parent_is_left ? links(grandparent).right
+            : links(grandparent).left;
+
+        // a red uncle means that the grandparent's blackness can be pushed
+        // down to both of its children, which might leave the grandparent
+        // with a red parent
+        if (is_red(uncle)) {
+            links(parent).red = false;
+            links(uncle).red = false;
+            links(grandparent).red = true;
+            node = grandparent;
+            continue;
+        }
+
+        // otherwise rotate the node to the outside if it is on the inside,
+        // and then rotate the parent up into the grandparent's place
+        if (parent_is_left) {
+            if (node == links(parent).right) {
+                this->rotate_left(parent);
+                parent = node;
+            }
+            this->rotate_right(grandparent);
+        } else {
+            if (node == links(parent).left) {
+                this->rotate_right(parent);
+                parent = node;
+            }
+            this->rotate_left(grandparent);
+        }
+        links(parent).red = false;
+        links(grandparent).red = true;
+        break;
+    }
+    links(this->root).red = false;
+}
+
+template <typename Node, typename Traits>
+void IntrusiveTree<Node, Traits>::fix_after_erase(Node* node, Node* parent)
+        noexcept {
+    // the node's side of the parent has one black node too few.  A node
+    // that is red can just be made black, otherwise the sibling (which
+    // cannot be a nullptr since its side has at least one black node) gives
+    // up a black node or the deficit moves up to the parent
+    while (node != this->root && !is_red(node)) {
+        auto node_is_left = (node == links(parent).left);
+        auto sibling = node_is_left ? links(parent).right : links(parent).left;
+        assert(sibling);
+
+        // make the sibling black by rotating a red sibling above the parent
+        if (is_red(sibling)) {
+            links(sibling).red = false;
+            links(parent).red = true;
+            if (node_is_left) {
+                this->rotate_left(parent);
+                sibling = links(parent).right;
+            } else {
+                this->rotate_right(parent);
+                sibling = links(parent).left;
+            }
+        }
+
+        // a black sibling with black children can be made red, which moves
+        // the deficit up to the parent
+        auto near = node_is_left ? links(sibling).left : links(sibling).right;
+        auto far = node_is_left ? links(sibling).right : links(sibling).left;
+        if (!is_red(near) && !is_red(far)) {
+            links(sibling).red = true;
+            node = parent;
+            parent = links(node).parent;
+            continue;
+        }
+
+        // otherwise make sure the far child of the sibling is red, and
+        // rotate the sibling above the parent, which fixes the deficit
+        if (!is_red(far)) {
+            links(near).red = false;
+            links(sibling).red = true;
+            if (node_is_left) {
+                this->rotate_right(sibling);
+                sibling = links(parent).right;
+            } else {
+                this->rotate_left(sibling);
+                sibling = links(parent).left;
+            }
+            far = node_is_left ? links(sibling).right : links(sibling).left;
+        }
+        links(sibling).red = links(parent).red;
+        links(parent).red = false;
+        links(far).red = false;
+        if (node_is_left) {
+            this->rotate_left(parent);
+        } else {
+            this->rotate_right(parent);
+        }
+        node = this->root;
+        break;
+    }
+    if (node) {
+        links(node).red = false;
+    }
+}
+
+} // namespace eecs281
@@ -0,0 +1,145 @@
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <unistd.h>
+
+#include "eecs281malloc.hpp"
+#include "os_memory.hpp"
+#include "Region.hpp"
+
+using std::uintptr_t;
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * Turns memory fetched from the operating system into a chunk, the
+     * header takes up the start of the memory
+     */
+    RegionChunk_t* make_region_chunk(std::pair<void*, int> memory);
+
+    /**
+     * Gives every chunk in the list back to the operating system and
+     * returns the number of bytes that were given back
+     */
+    std::int64_t release_chunks(RegionChunkList_t& list);
+
+    /**
+     * Returns the start and the end of the memory after the header of the
+     * chunk
+     */
+    uintptr_t chunk_begin(RegionChunk_t* chunk);
+    uintptr_t chunk_end(RegionChunk_t* chunk);
+
+} // namespace <anonymous>
+
+
+Region::Region(int chunk_amount, bool keep_spare_chunks)
+        : chunks{}, spare_chunks{}, large_chunks{}, cursor{0}, end{0},
+        chunk_size{round_up_to_max_alignment(
+                std::max(chunk_amount, getpagesize()))},
+        keep_chunks{keep_spare_chunks}, mapped{0} {}
+
+Region::~Region() {
+    this->release();
+}
+
+void Region::reset() {
+    this->mapped -= release_chunks(this->large_chunks);
+    if (this->keep_chunks) {
+        while (!this->chunks.empty()) {
+            auto chunk = *this->chunks.begin();
+            this->chunks.pop_front();
+            this->spare_chunks.push_front(chunk);
+        }
+    } else {
+        this->mapped -= release_chunks(this->chunks);
+    }
+    this->cursor = 0;
+    this->end = 0;
+}
+
+void Region::release() {
+    this->reset();
+    this->mapped -= release_chunks(this->spare_chunks);
+    assert(!this->mapped);
+}
+
+std::int64_t Region::mapped_bytes() const noexcept {
+    return this->mapped;
+}
+
+void* Region::allocate_from_new_chunk(int amount, int alignment) {
+    assert(alignment > 0 && !(alignment & (alignment - 1)));
+    if (amount < 0 || amount > MAXIMUM_REQUEST
+            || alignment > MAXIMUM_REQUEST - amount) {
+        throw std::bad_alloc{};
+    }
+
+    // memory that would not fit in a chunk of the usual size even with the
+    // worst padding gets a chunk of its own, which does not become the
+    // current chunk so that the rest of the current chunk is not wasted
+    auto needed = round_up_to_max_alignment(amount + alignment
+            + static_cast<int>(sizeof(RegionChunk_t)));
+    if (needed > this->chunk_size) {
+        auto chunk = make_region_chunk(extend_heap(needed));
+        this->large_chunks.push_front(chunk);
+        this->mapped += chunk->datum.length;
+        auto address = (chunk_begin(chunk) + alignment - 1)
+            & ~static_cast<uintptr_t>(alignment - 1);
+        assert(address + amount <= chunk_end(chunk));
+        return reinterpret_cast<void*>(address);
+    }
+
+    // otherwise the next chunk is one that an earlier reset() kept, or a
+    // fresh one
+    auto chunk = static_cast<RegionChunk_t*>(nullptr);
+    if (!this->spare_chunks.empty()) {
+        chunk = *this->spare_chunks.begin();
+        this->spare_chunks.pop_front();
+    } else {
+        chunk = make_region_chunk(extend_heap(this->chunk_size));
+        this->mapped += chunk->datum.length;
+    }
+    this->chunks.push_front(chunk);
+    this->cursor = chunk_begin(chunk);
+    this->end = chunk_end(chunk);
+    auto pointer = this->allocate(amount, alignment);
+    assert(pointer);
+    return pointer;
+}
+
+namespace {
+
+    RegionChunk_t* make_region_chunk(std::pair<void*, int> memory) {
+        assert(memory.second > static_cast<int>(sizeof(RegionChunk_t)));
+        return new (memory.first) RegionChunk_t{
+            RegionChunkMetadata{memory.second}};
+    }
+
+    std::int64_t release_chunks(RegionChunkList_t& list) {
+        auto released = std::int64_t{0};
+        while (!list.empty()) {
+            auto chunk = *list.begin();
+            list.pop_front();
+            released += chunk->datum.length;
+            release_heap(static_cast<void*>(chunk), chunk->datum.length);
+        }
+        return released;
+    }
+
+    uintptr_t chunk_begin(RegionChunk_t* chunk) {
+        return reinterpret_cast<uintptr_t>(chunk + 1);
+    }
+
+    uintptr_t chunk_end(RegionChunk_t* chunk) {
+        return reinterpret_cast<uintptr_t>(chunk) + chunk->datum.length;
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
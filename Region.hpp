@@ -0,0 +1,159 @@
+/**
+ * @file Region.hpp
+ * @author Aaryaman Sagar
+ *
+ * A region is a bump allocator for objects that all die at the same time,
+ * for example everything that a request handler allocates while it serves
+ * one request.  The region takes large chunks of memory straight from the
+ * operating system and hands out pieces of them by moving a cursor forward,
+ * so allocating is a pointer bump with no header in front of the memory and
+ * no free list behind it.  Nothing is freed on its own, the whole region is
+ * freed at once with reset() or when the region is destroyed
+ *
+ *  auto region = eecs281::Region{};
+ *  for (auto& request : requests) {
+ *      auto buffer = region.allocate(request.size());
+ *      ...
+ *      region.reset();
+ *  }
+ *
+ * A region keeps the chunks that it has used when it is reset unless it is
+ * told not to, so a region that is reused for every request stops making
+ * system calls once it has grown to the size of the largest request.
+ * Memory that is too large for a chunk gets a chunk of its own, which is
+ * always given back on a reset
+ *
+ * A region is not thread safe, and the memory in it does not show up in the
+ * statistics of the allocator
+ */
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "TransparentList.hpp"
+
+namespace eecs281 {
+
+/**
+ * The default size of the chunks that a region takes from the operating
+ * system
+ */
+constexpr auto DEFAULT_REGION_CHUNK_SIZE = 1 << 18;
+
+/**
+ * The header at the start of every chunk of a region, the chunks are linked
+ * through it and it records the length of the chunk
+ */
+struct RegionChunkMetadata {
+    int length;
+};
+using RegionChunkList_t = TransparentList<RegionChunkMetadata>;
+using RegionChunk_t = TransparentNode<RegionChunkMetadata>;
+
+class Region {
+public:
+
+    /**
+     * Makes an empty region, no memory is fetched until the first
+     * allocation
+     *
+     * @param chunk_amount the size of the chunks to take from the operating
+     *        system, this is rounded up to a whole number of pages
+     * @param keep_spare_chunks whether reset() keeps the chunks for the next
+     *        round of allocations or gives them back to the operating system
+     */
+    explicit Region(int chunk_amount = DEFAULT_REGION_CHUNK_SIZE,
+                    bool keep_spare_chunks = true);
+
+    /**
+     * Gives all of the region's memory back to the operating system, the
+     * region cannot be copied or moved since its memory is handed out by
+     * address
+     */
+    ~Region();
+    Region(const Region&) = delete;
+    Region& operator=(const Region&) = delete;
+
+    /**
+     * Allocates amount bytes aligned to the given alignment, the memory
+     * lives until the region is reset or destroyed.  This only moves the
+     * cursor forward unless the current chunk is full
+     *
+     * On error from the OS this function throws a std::bad_alloc exception
+     * to alert the user
+     *
+     * @param amount the amount of memory in bytes
+     * @param alignment the alignment of the memory, a power of two
+     */
+    void* allocate(int amount, int alignment = static_cast<int>(
+                alignof(std::max_align_t)));
+
+    /**
+     * Frees everything that was allocated in the region at once.  The chunks
+     * are kept for the next allocations if the region was made to keep them,
+     * otherwise they are given back to the operating system along with the
+     * chunks of memory that was too large for a chunk
+     */
+    void reset();
+
+    /**
+     * Frees everything that was allocated in the region and gives all of
+     * its memory back to the operating system, including the chunks that
+     * reset() kept
+     */
+    void release();
+
+    /**
+     * Returns the number of bytes of memory that the region has fetched from
+     * the operating system and still holds on to
+     */
+    std::int64_t mapped_bytes() const noexcept;
+
+private:
+
+    /**
+     * Starts a new chunk and allocates from it, this is the slow path of
+     * allocate().  Memory that does not fit in a chunk of the usual size
+     * gets a chunk of its own, and the current chunk is left as it is
+     */
+    void* allocate_from_new_chunk(int amount, int alignment);
+
+    /**
+     * The chunks that are being allocated from with the current one at the
+     * front, the chunks that reset() kept and the chunks of memory that was
+     * too large for a chunk.  The cursor and the end are the free part of
+     * the current chunk
+     */
+    RegionChunkList_t chunks;
+    RegionChunkList_t spare_chunks;
+    RegionChunkList_t large_chunks;
+    std::uintptr_t cursor;
+    std::uintptr_t end;
+
+    int chunk_size;
+    bool keep_chunks;
+    std::int64_t mapped;
+};
+
+/**
+ * The fast path of allocate() is defined here so that it can be inlined
+ * into the caller, the pointer bump is all that most allocations cost.  A
+ * region with no current chunk has its cursor and end at zero, so it always
+ * takes the slow path
+ */
+inline void* Region::allocate(int amount, int alignment) {
+    assert(alignment > 0 && !(alignment & (alignment - 1)));
+    auto address = (this->cursor + alignment - 1)
+        & ~static_cast<std::uintptr_t>(alignment - 1);
+    if (address < this->end
+            && static_cast<std::uintptr_t>(amount) <= this->end - address) {
+        this->cursor = address + amount;
+        return reinterpret_cast<void*>(address);
+    }
+    return this->allocate_from_new_chunk(amount, alignment);
+}
+
+} // namespace eecs281
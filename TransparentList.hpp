@@ -22,6 +22,7 @@
 
 #include <utility>
 #include <cassert>
+#include <cstddef>
 #include <iterator>
 #include <initializer_list>
 
@@ -80,9 +81,10 @@ public:
 
     /**
      * A default constructor that initializes the linked list to point to
-     * nothing at all
+     * nothing at all, this is constexpr so that lists with static storage
+     * duration are constant initialized
      */
-    TransparentList() noexcept;
+    constexpr TransparentList() noexcept;
 
     /**
      * Method to push back and front a node to the linked list, the node
@@ -110,6 +112,17 @@ public:
      */
     NodeIterator erase(NodeIterator iterator) noexcept;
 
+    /**
+     * Returns an iterator to a node that is in the linked list, this is
+     * constant time since the node itself contains its links
+     */
+    NodeIterator iterator_to(TransparentNode<Type>* node) noexcept;
+
+    /**
+     * Returns true if there are no nodes in the linked list
+     */
+    bool empty() const noexcept;
+
     /**
      * Return an iterator to the beginning of the linked list
      */
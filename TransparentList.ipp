@@ -76,8 +76,10 @@ public:
     }
 
     /**
-     * Assignment operator to assign to and from an iterator
+     * Copy constructor and assignment operator to copy to and from an
+     * iterator
      */
+    NodeIterator(const NodeIterator& other) noexcept = default;
     NodeIterator& operator=(const NodeIterator& other) noexcept {
         assert(is_satisfying_alignment_invariants(other.node_ptr));
         this->node_ptr = other.node_ptr;
@@ -136,7 +138,13 @@ auto TransparentList<Type>::end() noexcept {
 }
 
 template <typename Type>
-TransparentList<Type>::TransparentList() noexcept
+bool TransparentList<Type>::empty() const noexcept {
+    assert(static_cast<bool>(this->head) == static_cast<bool>(this->tail));
+    return !this->head;
+}
+
+template <typename Type>
+constexpr TransparentList<Type>::TransparentList() noexcept
         : head{nullptr}, tail{nullptr} {}
 
 template <typename Type>
@@ -221,6 +229,18 @@ void TransparentList<Type>::push_front(TransparentNode<Type>* node_to_insert)
     this->head = node_to_insert;
 }
 
+template <typename Type>
+void TransparentList<Type>::pop_back() noexcept {
+    assert(this->tail);
+    this->erase(NodeIterator{this->tail});
+}
+
+template <typename Type>
+void TransparentList<Type>::pop_front() noexcept {
+    assert(this->head);
+    this->erase(NodeIterator{this->head});
+}
+
 template <typename Type>
 typename TransparentList<Type>::NodeIterator
 TransparentList<Type>::insert(TransparentList<Type>::NodeIterator iterator,
@@ -247,6 +267,14 @@ TransparentList<Type>::insert(TransparentList<Type>::NodeIterator iterator,
     return NodeIterator{node_to_insert};
 }
 
+template <typename Type>
+typename TransparentList<Type>::NodeIterator
+TransparentList<Type>::iterator_to(TransparentNode<Type>* node) noexcept {
+    assert(is_satisfying_alignment_invariants(node));
+    assert(node);
+    return NodeIterator{node};
+}
+
 template <typename Type>
 typename TransparentList<Type>::NodeIterator
 TransparentList<Type>::erase(TransparentList<Type>::NodeIterator iterator)
@@ -264,19 +292,16 @@ TransparentList<Type>::erase(TransparentList<Type>::NodeIterator iterator)
         iterator.node_ptr->prev->next = iterator.node_ptr->next;
     }
 
-    // check if the pointer was at the head, in which case the head pointer
-    // has to be updated
+    // check if the pointer was at the head or the tail, in which case the
+    // head or tail pointer has to be updated.  If it was both then there was
+    // only one element and the list is now empty
     if (this->head == iterator.node_ptr) {
         this->head = this->head->next;
-
-        // if the tail was equal to the head then there was only one element
-        if (this->tail == iterator.node_ptr) {
-            assert(!this->head);
-            this->tail = nullptr;
-        }
-        return iterator_to_return;
     }
-    assert(this->tail != this->head);
+    if (this->tail == iterator.node_ptr) {
+        this->tail = this->tail->prev;
+    }
+    assert(static_cast<bool>(this->head) == static_cast<bool>(this->tail));
     return iterator_to_return;
 }
 
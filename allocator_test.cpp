@@ -0,0 +1,209 @@
+/**
+ * @file allocator_test.cpp
+ * @author Aaryaman Sagar
+ *
+ * Tests the STL allocator in Allocator.hpp and the memory resource in
+ * memory_resource.hpp by running standard containers on them, with element
+ * types of the fundamental alignment and with over-aligned ones.  The test
+ * turns tracing on before the first allocation and reads the trace back to
+ * check which call freed the memory, memory of an over-aligned type has to
+ * be freed with free() since free_sized() cannot be given the alignment.
+ * Build and run with
+ *
+ *  make check
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <memory_resource>
+#include <unistd.h>
+
+#include "Allocator.hpp"
+#include "memory_resource.hpp"
+#include "trace.hpp"
+
+using eecs281::Allocator;
+using eecs281::TraceOperation;
+using eecs281::TraceRecord;
+
+namespace {
+
+    /**
+     * The prefix of the trace file, the allocator appends the process id
+     */
+    constexpr auto TRACE_PATH = "/tmp/eecs281_allocator_test.trace";
+
+    /**
+     * An element type that is aligned to more than std::max_align_t
+     */
+    struct alignas(64) Wide {
+        int value;
+    };
+    static_assert(alignof(Wide) > alignof(std::max_align_t),
+            "Wide should be over-aligned");
+
+    /**
+     * The name of the trace file of this process
+     */
+    std::string trace_file();
+
+    /**
+     * Returns the size recorded by the latest free of the pointer in the
+     * trace, that is 0 for a free() and the size for a free_sized(), or -1
+     * when the trace has no free of the pointer
+     */
+    long traced_free_size(const void* pointer);
+
+    /**
+     * The tests, each one asserts on failure
+     */
+    void test_allocator_vector();
+    void test_allocator_unordered_map();
+    void test_allocator_free_calls();
+    void test_memory_resource();
+
+} // namespace <anonymous>
+
+int main() {
+    // the configuration is read on the first allocation, so this has to
+    // come before anything is allocated through the allocator
+    setenv("EECS281_MALLOC_TRACE", TRACE_PATH, 1);
+
+    test_allocator_vector();
+    test_allocator_unordered_map();
+    test_allocator_free_calls();
+    test_memory_resource();
+
+    unlink(trace_file().c_str());
+    std::cout << "allocator_test passed" << std::endl;
+    return 0;
+}
+
+namespace {
+
+    std::string trace_file() {
+        return std::string{TRACE_PATH} + "." + std::to_string(getpid());
+    }
+
+    long traced_free_size(const void* pointer) {
+        auto file = std::ifstream{trace_file(), std::ios::binary};
+        assert(file);
+        auto header = eecs281::TraceHeader{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        assert(file);
+
+        // the test runs on one thread, so the records are in the order of
+        // the calls as long as the ring has not wrapped around
+        auto number = header.cursor.load();
+        assert(number <= header.capacity);
+        auto size = -1L;
+        auto record = TraceRecord{};
+        for (auto i = std::uint64_t{0}; i < number; ++i) {
+            file.read(reinterpret_cast<char*>(&record), sizeof(record));
+            assert(file);
+            if (record.operation == TraceOperation::FREE
+                    && record.pointer == reinterpret_cast<uintptr_t>(pointer)) {
+                size = record.size;
+            }
+        }
+        return size;
+    }
+
+    void test_allocator_vector() {
+        auto numbers = std::vector<int, Allocator<int>>{};
+        for (auto i = 0; i < 100000; ++i) {
+            numbers.push_back(i);
+        }
+        for (auto i = 0; i < 100000; ++i) {
+            assert(numbers[i] == i);
+        }
+
+        // every reallocation of the buffer has to keep the alignment
+        auto wides = std::vector<Wide, Allocator<Wide>>{};
+        for (auto i = 0; i < 10000; ++i) {
+            wides.push_back(Wide{i});
+            assert(!(reinterpret_cast<uintptr_t>(wides.data())
+                        % alignof(Wide)));
+        }
+        for (auto i = 0; i < 10000; ++i) {
+            assert(wides[i].value == i);
+        }
+
+        // allocators of different types compare equal and can be copied
+        // into each other, as the containers rebind them
+        auto copy = Allocator<Wide>{numbers.get_allocator()};
+        assert(copy == wides.get_allocator());
+        assert(!(copy != Allocator<int>{}));
+    }
+
+    void test_allocator_unordered_map() {
+        using Map = std::unordered_map<int, Wide, std::hash<int>,
+              std::equal_to<int>, Allocator<std::pair<const int, Wide>>>;
+        auto map = Map{};
+        for (auto i = 0; i < 50000; ++i) {
+            map.emplace(i, Wide{i * 2});
+        }
+        for (auto i = 0; i < 50000; i += 2) {
+            map.erase(i);
+        }
+        assert(map.size() == 25000);
+        for (auto i = 0; i < 50000; ++i) {
+            auto found = map.find(i);
+            assert((found != map.end()) == (i % 2 == 1));
+            if (found != map.end()) {
+                assert(found->second.value == i * 2);
+                assert(!(reinterpret_cast<uintptr_t>(&found->second)
+                            % alignof(Wide)));
+            }
+        }
+    }
+
+    void test_allocator_free_calls() {
+        // the trace is read right after each free, since a later allocation
+        // can reuse the address
+        auto wide_allocator = Allocator<Wide>{};
+        auto wides = wide_allocator.allocate(3);
+        assert(!(reinterpret_cast<uintptr_t>(wides) % alignof(Wide)));
+        wide_allocator.deallocate(wides, 3);
+        assert(traced_free_size(wides) == 0);
+
+        auto int_allocator = Allocator<int>{};
+        auto numbers = int_allocator.allocate(5);
+        int_allocator.deallocate(numbers, 5);
+        assert(traced_free_size(numbers) == 5 * sizeof(int));
+    }
+
+    void test_memory_resource() {
+        auto resource = eecs281::malloc_resource();
+        assert(resource->is_equal(*eecs281::malloc_resource()));
+        assert(!resource->is_equal(*std::pmr::new_delete_resource()));
+
+        auto numbers = std::pmr::vector<int>{resource};
+        auto map = std::pmr::unordered_map<int, Wide>{resource};
+        for (auto i = 0; i < 50000; ++i) {
+            numbers.push_back(i);
+            map.emplace(i, Wide{i});
+        }
+        for (auto i = 0; i < 50000; ++i) {
+            assert(numbers[i] == i);
+            assert(map.at(i).value == i);
+            assert(!(reinterpret_cast<uintptr_t>(&map.at(i)) % alignof(Wide)));
+        }
+
+        auto aligned = resource->allocate(100, 256);
+        assert(!(reinterpret_cast<uintptr_t>(aligned) % 256));
+        resource->deallocate(aligned, 100, 256);
+        assert(traced_free_size(aligned) == 0);
+
+        auto plain = resource->allocate(100, alignof(std::max_align_t));
+        resource->deallocate(plain, 100, alignof(std::max_align_t));
+        assert(traced_free_size(plain) == 100);
+    }
+
+} // namespace <anonymous>
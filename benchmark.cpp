@@ -0,0 +1,658 @@
+/**
+ * @file benchmark.cpp
+ * @author Aaryaman Sagar
+ *
+ * The benchmark suite of the allocator.  Every workload is run once with
+ * this allocator and once with the system's malloc(3) as a baseline, each
+ * run in a fresh process of its own so that the peak resident memory of
+ * one run does not carry over into the next.  The workloads are
+ *
+ *  fixed           every thread allocates and frees batches of 64 byte
+ *                  objects, the best case for the thread caches
+ *  random          every thread keeps a fixed number of live objects and
+ *                  replaces a random one with an object of a random size on
+ *                  every step, mostly small sizes with some larger ones
+ *  producer        threads are paired up, one thread of every pair
+ *                  allocates objects and passes them to the other one
+ *                  through a queue, which frees them
+ *  larson          like random, but the threads pass their sets of live
+ *                  objects on to the next thread after every round, so most
+ *                  objects are freed by a thread other than the one that
+ *                  allocated them (after the benchmark by Larson and Krishnan)
+ *  xmalloc         every thread allocates batches of objects and puts them
+ *                  on a shared stack, and frees whichever batch it takes off
+ *                  the stack (after xmalloc-test by Lever and Boreham)
+ *  fragmentation   every thread fills its share of the heap with objects of
+ *                  random sizes, frees three quarters of them at random and
+ *                  refills the heap with larger objects, a few times over
+ *
+ * For every run the benchmark reports the throughput in millions of
+ * operations (a malloc or a free) per second, the 50th, 99th and 99.9th
+ * percentile latency of a single operation, the peak resident memory that
+ * the run added to the process and the fragmentation ratio, which is that
+ * peak divided by the peak number of bytes that the program had live.  The
+ * latency of one in every LATENCY_SAMPLE_RATE operations is measured with
+ * the steady clock, so the latencies include the cost of reading the clock
+ *
+ * The seeds and the numbers of operations are fixed, so the runs only
+ * differ in how the threads are scheduled.  Build and run with
+ *
+ *  make benchmark
+ *  ./benchmark [workload or all] [number of threads]
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <iterator>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "eecs281malloc.hpp"
+
+namespace {
+
+    /**
+     * The parameters of the workloads, the numbers of operations are per
+     * thread
+     */
+    constexpr auto FIXED_SIZE = 64;
+    constexpr auto FIXED_BATCH = 100;
+    constexpr auto FIXED_OPERATIONS = 8000000;
+    constexpr auto RANDOM_SLOTS = 1000;
+    constexpr auto RANDOM_OPERATIONS = 4000000;
+    constexpr auto MAXIMUM_SMALL_SIZE = 512;
+    constexpr auto MAXIMUM_LARGE_SIZE = 8192;
+    constexpr auto PRODUCER_OPERATIONS = 4000000;
+    constexpr auto QUEUE_SIZE = 1024;
+    constexpr auto LARSON_SLOTS = 1000;
+    constexpr auto LARSON_ROUNDS = 40;
+    constexpr auto LARSON_STEPS = 50000;
+    constexpr auto LARSON_MAXIMUM_SIZE = 1024;
+    constexpr auto XMALLOC_BATCH = 64;
+    constexpr auto XMALLOC_BATCHES_PER_THREAD = 4;
+    constexpr auto XMALLOC_ROUNDS = 30000;
+    constexpr auto XMALLOC_MAXIMUM_SIZE = 256;
+    constexpr auto FRAGMENTATION_BYTES = 256 << 20;
+    constexpr auto FRAGMENTATION_CYCLES = 4;
+    constexpr auto FRAGMENTATION_MAXIMUM_SIZE = 16384;
+
+    /**
+     * One in this many operations is timed
+     */
+    constexpr auto LATENCY_SAMPLE_RATE = 64;
+
+    /**
+     * The interval at which the number of live bytes is sampled to find
+     * its peak
+     */
+    constexpr auto MONITOR_INTERVAL = std::chrono::microseconds{500};
+
+    /**
+     * The flag that tells the benchmark that it has been run by itself to
+     * do a single run
+     */
+    constexpr auto RUN_FLAG = "--run";
+
+    /**
+     * Adapters so that the workloads can be run with either allocator
+     */
+    struct Eecs281Allocator {
+        static constexpr auto name = "eecs281";
+        static void* allocate(int amount) { return eecs281::malloc(amount); }
+        static void deallocate(void* pointer) { eecs281::free(pointer); }
+    };
+    struct SystemAllocator {
+        static constexpr auto name = "system";
+        static void* allocate(int amount) { return std::malloc(amount); }
+        static void deallocate(void* pointer) { std::free(pointer); }
+    };
+
+    /**
+     * An object that a workload has allocated along with its size
+     */
+    struct Slot {
+        void* pointer;
+        int size;
+    };
+
+    /**
+     * The state of one thread of a run.  The live bytes are written only by
+     * the thread itself and read by the monitor, a thread that frees an
+     * object that another thread allocated subtracts its size from its own
+     * count so only the sum over all threads is meaningful
+     */
+    struct alignas(64) ThreadState {
+        std::atomic<std::int64_t> live_bytes{0};
+        std::uint64_t operations{0};
+        std::vector<std::uint32_t> latencies;
+        std::mt19937 engine;
+    };
+
+    /**
+     * A single producer single consumer queue of objects
+     */
+    struct Queue {
+        alignas(64) std::atomic<std::uint32_t> head{0};
+        alignas(64) std::atomic<std::uint32_t> tail{0};
+        Slot slots[QUEUE_SIZE];
+    };
+
+    /**
+     * A barrier that the threads spin on between the rounds of a workload
+     */
+    class Barrier {
+    public:
+        explicit Barrier(int number_threads) : number_threads{number_threads} {}
+        void wait();
+    private:
+        const int number_threads;
+        std::atomic<int> arrived{0};
+        std::atomic<int> generation{0};
+    };
+
+    /**
+     * Everything that the threads of a run share
+     */
+    struct Context {
+        explicit Context(int number_threads);
+
+        int number_threads;
+        std::vector<ThreadState> threads;
+        Barrier barrier;
+
+        // one queue for every pair of threads in the producer workload
+        std::vector<Queue> queues;
+
+        // the sets of live objects that are passed around in the larson
+        // workload, thread i works on set (i + round) % number_threads
+        std::vector<std::vector<Slot>> larson_sets;
+
+        // the batches of the xmalloc workload, the indices of the batches
+        // that are empty and of those that hold live objects
+        std::mutex xmalloc_mutex;
+        std::vector<std::vector<Slot>> xmalloc_batches;
+        std::vector<int> empty_batches;
+        std::vector<int> full_batches;
+    };
+
+    /**
+     * Returns the time on the steady clock in nanoseconds
+     */
+    std::int64_t now();
+
+    /**
+     * Allocate and free an object on behalf of the thread, counting the
+     * operation and the live bytes and timing one in every
+     * LATENCY_SAMPLE_RATE operations.  Every allocated object is written to
+     * so that its memory is touched like a program would touch it
+     */
+    template <typename Allocator>
+    Slot allocate(ThreadState& thread, int size);
+    template <typename Allocator>
+    void deallocate(ThreadState& thread, const Slot& slot);
+
+    /**
+     * Returns a random size for an object, mostly small sizes with one in
+     * sixteen of them larger
+     */
+    int random_size(std::mt19937& engine);
+
+    /**
+     * The workloads, each of these is the body of one thread of a run
+     */
+    template <typename Allocator>
+    void fixed(Context& context, int index);
+    template <typename Allocator>
+    void random(Context& context, int index);
+    template <typename Allocator>
+    void producer(Context& context, int index);
+    template <typename Allocator>
+    void larson(Context& context, int index);
+    template <typename Allocator>
+    void xmalloc(Context& context, int index);
+    template <typename Allocator>
+    void fragmentation(Context& context, int index);
+
+    /**
+     * The table of workloads, in the order that they are run in, along with
+     * the fewest threads that each of them can run on
+     */
+    struct Workload {
+        const char* name;
+        int minimum_threads;
+        void (*eecs281)(Context&, int);
+        void (*system)(Context&, int);
+    };
+    const Workload workloads[] = {
+        {"fixed", 1, fixed<Eecs281Allocator>, fixed<SystemAllocator>},
+        {"random", 1, random<Eecs281Allocator>, random<SystemAllocator>},
+        {"producer", 2, producer<Eecs281Allocator>, producer<SystemAllocator>},
+        {"larson", 1, larson<Eecs281Allocator>, larson<SystemAllocator>},
+        {"xmalloc", 1, xmalloc<Eecs281Allocator>, xmalloc<SystemAllocator>},
+        {"fragmentation", 1, fragmentation<Eecs281Allocator>,
+            fragmentation<SystemAllocator>},
+    };
+
+    /**
+     * Returns the peak resident memory of the process in bytes
+     */
+    std::int64_t peak_resident_bytes();
+
+    /**
+     * Runs the workload on the given number of threads with one of the
+     * allocators and prints a row of results
+     */
+    void run(const Workload& workload, const std::string& allocator,
+             int number_threads);
+
+    /**
+     * Runs the workload in a child process
+     */
+    void run_in_child(const char* program, const char* workload,
+                      const char* allocator, const char* number_threads);
+
+} // namespace <anonymous>
+
+
+int main(int argc, char** argv) {
+    if (argc > 4 && !std::strcmp(argv[1], RUN_FLAG)) {
+        for (const auto& workload : workloads) {
+            if (workload.name == std::string{argv[2]}) {
+                run(workload, argv[3], std::atoi(argv[4]));
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    auto selected = std::string{(argc > 1) ? argv[1] : "all"};
+    auto number_threads = std::to_string((argc > 2) ? std::atoi(argv[2])
+            : static_cast<int>(std::max(1u,
+                    std::thread::hardware_concurrency())));
+
+    auto known = selected == "all" || std::any_of(std::begin(workloads),
+            std::end(workloads), [&](const Workload& workload) {
+                return selected == workload.name;
+            });
+    if (!known) {
+        std::cerr << "unknown workload " << selected << std::endl;
+        return 1;
+    }
+
+    std::cout << std::left << std::setw(15) << "workload" << std::right
+              << std::setw(9) << "malloc" << std::setw(9) << "threads"
+              << std::setw(10) << "Mops/s" << std::setw(9) << "p50 ns"
+              << std::setw(9) << "p99 ns" << std::setw(10) << "p999 ns"
+              << std::setw(12) << "peak MiB" << std::setw(8) << "frag"
+              << std::endl;
+    for (const auto& workload : workloads) {
+        if (selected != "all" && selected != workload.name) {
+            continue;
+        }
+        for (auto allocator : {"eecs281", "system"}) {
+            run_in_child(argv[0], workload.name, allocator,
+                    number_threads.c_str());
+        }
+    }
+    return 0;
+}
+
+namespace {
+
+    void Barrier::wait() {
+        auto current = this->generation.load();
+        if (this->arrived.fetch_add(1) + 1 == this->number_threads) {
+            this->arrived.store(0);
+            this->generation.fetch_add(1);
+            return;
+        }
+        while (this->generation.load() == current) {
+            std::this_thread::yield();
+        }
+    }
+
+    Context::Context(int number_threads)
+            : number_threads{number_threads}, threads(number_threads),
+            barrier{number_threads}, queues(number_threads / 2 + 1),
+            larson_sets(number_threads) {
+        for (auto index = 0; index < number_threads; ++index) {
+            this->threads[index].engine.seed(index + 1);
+        }
+        auto number_batches = number_threads * XMALLOC_BATCHES_PER_THREAD;
+        this->xmalloc_batches.resize(number_batches);
+        for (auto index = 0; index < number_batches; ++index) {
+            this->xmalloc_batches[index].reserve(XMALLOC_BATCH);
+            this->empty_batches.push_back(index);
+        }
+        this->full_batches.reserve(number_batches);
+    }
+
+    std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void count_live_bytes(ThreadState& thread, std::int64_t change) {
+        thread.live_bytes.store(thread.live_bytes.load(
+                    std::memory_order_relaxed) + change,
+                std::memory_order_relaxed);
+    }
+
+    template <typename Allocator>
+    Slot allocate(ThreadState& thread, int size) {
+        auto pointer = static_cast<void*>(nullptr);
+        if (thread.operations++ % LATENCY_SAMPLE_RATE) {
+            pointer = Allocator::allocate(size);
+        } else {
+            auto start = now();
+            pointer = Allocator::allocate(size);
+            thread.latencies.push_back(static_cast<std::uint32_t>(
+                        now() - start));
+        }
+        *static_cast<char*>(pointer) = static_cast<char>(size);
+        count_live_bytes(thread, size);
+        return Slot{pointer, size};
+    }
+
+    template <typename Allocator>
+    void deallocate(ThreadState& thread, const Slot& slot) {
+        if (thread.operations++ % LATENCY_SAMPLE_RATE) {
+            Allocator::deallocate(slot.pointer);
+        } else {
+            auto start = now();
+            Allocator::deallocate(slot.pointer);
+            thread.latencies.push_back(static_cast<std::uint32_t>(
+                        now() - start));
+        }
+        count_live_bytes(thread, -slot.size);
+    }
+
+    int random_size(std::mt19937& engine) {
+        if (engine() % 16) {
+            return 1 + static_cast<int>(engine() % MAXIMUM_SMALL_SIZE);
+        }
+        return MAXIMUM_SMALL_SIZE + 1 + static_cast<int>(engine()
+                % (MAXIMUM_LARGE_SIZE - MAXIMUM_SMALL_SIZE));
+    }
+
+    template <typename Allocator>
+    void fixed(Context& context, int index) {
+        auto& thread = context.threads[index];
+        auto batch = std::vector<Slot>(FIXED_BATCH);
+        for (auto i = 0; i < FIXED_OPERATIONS / (2 * FIXED_BATCH); ++i) {
+            for (auto& slot : batch) {
+                slot = allocate<Allocator>(thread, FIXED_SIZE);
+            }
+            for (const auto& slot : batch) {
+                deallocate<Allocator>(thread, slot);
+            }
+        }
+    }
+
+    template <typename Allocator>
+    void random(Context& context, int index) {
+        auto& thread = context.threads[index];
+        auto slots = std::vector<Slot>(RANDOM_SLOTS);
+        for (auto& slot : slots) {
+            slot = allocate<Allocator>(thread, random_size(thread.engine));
+        }
+        for (auto i = 0; i < RANDOM_OPERATIONS / 2; ++i) {
+            auto& slot = slots[thread.engine() % RANDOM_SLOTS];
+            deallocate<Allocator>(thread, slot);
+            slot = allocate<Allocator>(thread, random_size(thread.engine));
+        }
+        for (const auto& slot : slots) {
+            deallocate<Allocator>(thread, slot);
+        }
+    }
+
+    template <typename Allocator>
+    void producer(Context& context, int index) {
+        // the threads are paired up, the even thread of a pair produces and
+        // the odd one consumes, a thread without a partner sits out
+        auto& thread = context.threads[index];
+        auto& queue = context.queues[index / 2];
+        auto partnered = (index | 1) < context.number_threads;
+        if (!partnered) {
+            return;
+        }
+
+        for (std::uint32_t i = 0; i < PRODUCER_OPERATIONS / 2; ++i) {
+            if (!(index % 2)) {
+                auto slot = allocate<Allocator>(thread,
+                        random_size(thread.engine));
+                while (i - queue.head.load(std::memory_order_acquire)
+                        == QUEUE_SIZE) {
+                    std::this_thread::yield();
+                }
+                queue.slots[i % QUEUE_SIZE] = slot;
+                queue.tail.store(i + 1, std::memory_order_release);
+            } else {
+                while (queue.tail.load(std::memory_order_acquire) == i) {
+                    std::this_thread::yield();
+                }
+                auto slot = queue.slots[i % QUEUE_SIZE];
+                queue.head.store(i + 1, std::memory_order_release);
+                deallocate<Allocator>(thread, slot);
+            }
+        }
+    }
+
+    template <typename Allocator>
+    void larson(Context& context, int index) {
+        auto& thread = context.threads[index];
+        auto size = std::uniform_int_distribution<int>{16,
+            LARSON_MAXIMUM_SIZE};
+        auto& first_set = context.larson_sets[index];
+        first_set.resize(LARSON_SLOTS);
+        for (auto& slot : first_set) {
+            slot = allocate<Allocator>(thread, size(thread.engine));
+        }
+
+        // after every round the sets move on to the next thread, so the
+        // objects in them are freed by threads that did not allocate them
+        for (auto round = 0; round < LARSON_ROUNDS; ++round) {
+            context.barrier.wait();
+            auto& set = context.larson_sets[(index + round)
+                % context.number_threads];
+            for (auto step = 0; step < LARSON_STEPS; ++step) {
+                auto& slot = set[thread.engine() % LARSON_SLOTS];
+                deallocate<Allocator>(thread, slot);
+                slot = allocate<Allocator>(thread, size(thread.engine));
+            }
+        }
+
+        context.barrier.wait();
+        for (const auto& slot : first_set) {
+            deallocate<Allocator>(thread, slot);
+        }
+    }
+
+    template <typename Allocator>
+    void xmalloc(Context& context, int index) {
+        auto& thread = context.threads[index];
+        auto size = std::uniform_int_distribution<int>{1,
+            XMALLOC_MAXIMUM_SIZE};
+
+        // a batch that is taken off the shared stack can have been filled
+        // by any thread
+        for (auto round = 0; round < XMALLOC_ROUNDS; ++round) {
+            auto batch = 0;
+            {
+                std::lock_guard<std::mutex> lock{context.xmalloc_mutex};
+                batch = context.empty_batches.back();
+                context.empty_batches.pop_back();
+            }
+            for (auto i = 0; i < XMALLOC_BATCH; ++i) {
+                context.xmalloc_batches[batch].push_back(
+                        allocate<Allocator>(thread, size(thread.engine)));
+            }
+            {
+                std::lock_guard<std::mutex> lock{context.xmalloc_mutex};
+                context.full_batches.push_back(batch);
+                batch = context.full_batches.front();
+                context.full_batches.erase(context.full_batches.begin());
+            }
+            for (const auto& slot : context.xmalloc_batches[batch]) {
+                deallocate<Allocator>(thread, slot);
+            }
+            context.xmalloc_batches[batch].clear();
+            {
+                std::lock_guard<std::mutex> lock{context.xmalloc_mutex};
+                context.empty_batches.push_back(batch);
+            }
+        }
+    }
+
+    template <typename Allocator>
+    void fragmentation(Context& context, int index) {
+        auto& thread = context.threads[index];
+        auto share = static_cast<std::int64_t>(FRAGMENTATION_BYTES)
+            / context.number_threads;
+        auto slots = std::vector<Slot>{};
+        slots.reserve(share / 16);
+
+        // every cycle frees three quarters of the objects, leaving holes
+        // between the survivors, and refills the heap with objects that are
+        // twice as large on average as those of the cycle before
+        auto live = std::int64_t{0};
+        auto maximum_size = FRAGMENTATION_MAXIMUM_SIZE / 8;
+        for (auto cycle = 0; cycle < FRAGMENTATION_CYCLES; ++cycle) {
+            auto size = std::uniform_int_distribution<int>{16, maximum_size};
+            while (live < share) {
+                slots.push_back(allocate<Allocator>(thread,
+                            size(thread.engine)));
+                live += slots.back().size;
+            }
+            std::shuffle(slots.begin(), slots.end(), thread.engine);
+            auto survivors = slots.size() / 4;
+            for (auto i = survivors; i < slots.size(); ++i) {
+                live -= slots[i].size;
+                deallocate<Allocator>(thread, slots[i]);
+            }
+            slots.resize(survivors);
+            maximum_size *= 2;
+        }
+        for (const auto& slot : slots) {
+            deallocate<Allocator>(thread, slot);
+        }
+    }
+
+    std::int64_t peak_resident_bytes() {
+        auto usage = rusage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<std::int64_t>(usage.ru_maxrss) * 1024;
+    }
+
+    void run(const Workload& workload, const std::string& allocator,
+             int number_threads) {
+        number_threads = std::max(number_threads, workload.minimum_threads);
+        auto context = Context{number_threads};
+        auto body = (allocator == "system") ? workload.system
+            : workload.eecs281;
+        auto expected_samples = std::max({FIXED_OPERATIONS,
+                RANDOM_OPERATIONS + 2 * RANDOM_SLOTS, PRODUCER_OPERATIONS,
+                (LARSON_ROUNDS * LARSON_STEPS + LARSON_SLOTS) * 2,
+                XMALLOC_ROUNDS * XMALLOC_BATCH * 2,
+                FRAGMENTATION_BYTES / 16}) / LATENCY_SAMPLE_RATE + 1;
+        for (auto& thread : context.threads) {
+            thread.latencies.reserve(expected_samples);
+        }
+        auto resident_before = peak_resident_bytes();
+
+        // the monitor samples the total number of live bytes while the
+        // workload runs to find its peak
+        auto done = std::atomic<bool>{false};
+        auto peak_live = std::int64_t{0};
+        auto monitor = std::thread{[&]() {
+            while (!done.load()) {
+                auto live = std::int64_t{0};
+                for (const auto& thread : context.threads) {
+                    live += thread.live_bytes.load(std::memory_order_relaxed);
+                }
+                peak_live = std::max(peak_live, live);
+                std::this_thread::sleep_for(MONITOR_INTERVAL);
+            }
+        }};
+
+        auto start = std::chrono::steady_clock::now();
+        auto threads = std::vector<std::thread>{};
+        for (auto index = 0; index < number_threads; ++index) {
+            threads.emplace_back(body, std::ref(context), index);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        auto elapsed = std::chrono::duration<double>{
+            std::chrono::steady_clock::now() - start};
+        done.store(true);
+        monitor.join();
+
+        auto operations = std::uint64_t{0};
+        auto latencies = std::vector<std::uint32_t>{};
+        for (auto& thread : context.threads) {
+            operations += thread.operations;
+            latencies.insert(latencies.end(), thread.latencies.begin(),
+                    thread.latencies.end());
+        }
+        auto percentile = [&](double fraction) -> std::uint32_t {
+            if (latencies.empty()) {
+                return 0;
+            }
+            auto nth = latencies.begin() + static_cast<std::ptrdiff_t>(
+                    fraction * static_cast<double>(latencies.size() - 1));
+            std::nth_element(latencies.begin(), nth, latencies.end());
+            return *nth;
+        };
+        auto peak_resident = peak_resident_bytes() - resident_before;
+
+        std::cout << std::left << std::setw(15) << workload.name
+                  << std::right << std::setw(9) << allocator
+                  << std::setw(9) << number_threads
+                  << std::setw(10) << std::fixed << std::setprecision(2)
+                  << operations / elapsed.count() / 1e6
+                  << std::setw(9) << percentile(0.5)
+                  << std::setw(9) << percentile(0.99)
+                  << std::setw(10) << percentile(0.999)
+                  << std::setw(12) << std::setprecision(1)
+                  << peak_resident / 1048576.0
+                  << std::setw(8) << std::setprecision(2)
+                  << (peak_live ? static_cast<double>(peak_resident)
+                          / static_cast<double>(peak_live) : 0.0)
+                  << std::endl;
+    }
+
+    void run_in_child(const char* program, const char* workload,
+                      const char* allocator, const char* number_threads) {
+        auto child = fork();
+        if (child < 0) {
+            std::perror("fork");
+            return;
+        }
+        if (!child) {
+            auto arguments = std::vector<char*>{const_cast<char*>(program),
+                const_cast<char*>(RUN_FLAG), const_cast<char*>(workload),
+                const_cast<char*>(allocator),
+                const_cast<char*>(number_threads), nullptr};
+            execv("/proc/self/exe", arguments.data());
+            std::perror("execv");
+            std::_Exit(1);
+        }
+        auto status = 0;
+        waitpid(child, &status, 0);
+    }
+
+} // namespace <anonymous>
@@ -0,0 +1,193 @@
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <new>
+#include <utility>
+#include <unistd.h>
+
+#include "block.hpp"
+
+using std::uintptr_t;
+
+namespace eecs281 {
+
+Header_t* make_header(void* address, int amount) {
+    assert(boundary_aligned(address));
+    assert(boundary_aligned(amount));
+    assert(boundary_aligned(sizeof(Header_t)));
+
+    // if the header cannot serve any memory request then return a nullptr
+    // to indicate that the header is not suitable for usage
+    if (amount <= static_cast<int>(sizeof(Header_t))) {
+        return nullptr;
+    }
+
+    // set the size variable in the header to be the previous size minus the
+    // amount that is needed for the header, this will still result in the
+    // address range being aligned since the node type's alignment has been
+    // set to the maximum alignment on the system (i.e.
+    // alignof(std::max_align_t)
+    auto new_size = static_cast<int>(amount - sizeof(Header_t));
+    auto header_ptr = new(address) Header_t{BlockMetadata{new_size, 0, 0,
+        nullptr}};
+    return header_ptr;
+}
+
+Header_t* remove_memory(Header_t* header_ptr, int amount) {
+    assert(header_ptr);
+    assert(boundary_aligned(header_ptr));
+    assert(boundary_aligned(amount));
+    assert(boundary_aligned(header_ptr->datum.size));
+
+    // if the header does not contain enough memory for the amount to be
+    // reduced then return nullptr
+    if (header_ptr->datum.size < amount) {
+        return nullptr;
+    }
+
+    // attempt to create another header from the current header, if there is
+    // enough memory for another header then one will be created
+    auto new_header = make_header(reinterpret_cast<void*>(
+                reinterpret_cast<uintptr_t>(header_ptr + 1) + amount),
+            header_ptr->datum.size - amount);
+    if (new_header) {
+        assert(boundary_aligned(new_header));
+        assert(boundary_aligned(new_header->datum.size));
+
+        // change the amount of memory right after the old header to be the
+        // amount that was requested, the new block belongs to the same
+        // arena as the old one
+        header_ptr->datum.size = amount;
+        new_header->datum.arena = header_ptr->datum.arena;
+        return new_header;
+    }
+
+    // else return the same pointer to indicate that it can serve the
+    // request but not more than it
+    return header_ptr;
+}
+
+Header_t* coalesce(Header_t* header_one, Header_t* header_two) {
+    // assert a bunch of things
+    assert(header_one);
+    assert(header_two);
+    assert(boundary_aligned(header_one));
+    assert(boundary_aligned(header_two));
+    assert(header_one != header_two);
+    assert(boundary_aligned(header_one->datum.size));
+    assert(boundary_aligned(header_two->datum.size));
+    assert(header_one->datum.arena == header_two->datum.arena);
+
+    // assign the lesser of the two to be the min_header, since we need to
+    // coalesce the blocks, and we don't care about the order in which the
+    // blocks are given
+    auto min_header = std::min(header_one, header_two);
+    auto max_header = std::max(header_one, header_two);
+
+    // if the max one is immediately after the lesser one, then coalesce them
+    // and return the pointer to the coalesced block
+    if (reinterpret_cast<uintptr_t>(min_header + 1) + min_header->datum.size
+            == reinterpret_cast<uintptr_t>(max_header)) {
+        min_header->datum.size += sizeof(Header_t);
+        min_header->datum.size += max_header->datum.size;
+        return min_header;
+    }
+
+    return nullptr;
+}
+
+Header_t* next_block(Header_t* header_ptr) {
+    return reinterpret_cast<Header_t*>(
+            reinterpret_cast<uintptr_t>(header_ptr + 1)
+            + header_ptr->datum.size);
+}
+
+Header_t* previous_block(Header_t* header_ptr) {
+    assert(!(header_ptr->datum.flags & PREV_IN_USE));
+
+    // the footer is the last int in the block before, it contains the size
+    // of that block
+    auto size = *(reinterpret_cast<int*>(header_ptr) - 1);
+    assert(boundary_aligned(size));
+    auto before = reinterpret_cast<Header_t*>(
+            reinterpret_cast<uintptr_t>(header_ptr - 1) - size);
+    assert(before->datum.size == size);
+    assert(!(before->datum.flags & IN_USE));
+    return before;
+}
+
+void mark_in_use(Header_t* header_ptr) {
+    header_ptr->datum.flags |= IN_USE;
+    next_block(header_ptr)->datum.flags |= PREV_IN_USE;
+}
+
+void mark_free(Header_t* header_ptr) {
+    auto after = next_block(header_ptr);
+    header_ptr->datum.flags &= ~IN_USE;
+    *(reinterpret_cast<int*>(after) - 1) = header_ptr->datum.size;
+    after->datum.flags &= ~PREV_IN_USE;
+}
+
+Header_t* make_chunk(std::pair<void*, int> memory, int arena) {
+    assert(boundary_aligned(memory.first));
+    assert(boundary_aligned(memory.second));
+
+    // the fence takes up the last header sized part of the chunk and the
+    // rest of the chunk is one free block
+    auto fence_address = reinterpret_cast<void*>(
+            reinterpret_cast<uintptr_t>(memory.first) + memory.second
+            - sizeof(Header_t));
+    auto arena_index = static_cast<std::uint16_t>(arena);
+    new(fence_address) Header_t{BlockMetadata{0, IN_USE, arena_index,
+        nullptr}};
+    auto header_ptr = make_header(memory.first,
+            memory.second - static_cast<int>(sizeof(Header_t)));
+    assert(header_ptr);
+    assert(next_block(header_ptr) == fence_address);
+    header_ptr->datum.flags = PREV_IN_USE | ZEROED;
+    header_ptr->datum.arena = arena_index;
+    mark_free(header_ptr);
+    return header_ptr;
+}
+
+Header_t* make_mapped_block(std::pair<void*, int> memory) {
+    auto header_ptr = make_header(memory.first, memory.second);
+    assert(header_ptr);
+    header_ptr->datum.flags = IN_USE | PREV_IN_USE | MAPPED;
+    return header_ptr;
+}
+
+std::pair<void*, int> mapped_region(Header_t* header_ptr) {
+    assert(header_ptr->datum.flags & MAPPED);
+
+    // the header need not be at the start of the mapping, for example when
+    // the user's pointer had to be aligned to more than a page, so round it
+    // down to the page that it is on
+    auto page_size = static_cast<uintptr_t>(getpagesize());
+    auto start = reinterpret_cast<uintptr_t>(header_ptr) & ~(page_size - 1);
+    auto end = reinterpret_cast<uintptr_t>(next_block(header_ptr));
+    assert(!(end % page_size));
+    return std::make_pair(reinterpret_cast<void*>(start),
+            static_cast<int>(end - start));
+}
+
+std::pair<void*, int> purgeable_region(Header_t* header_ptr) {
+    // the pages are the ones that lie entirely between the end of the tree
+    // links after the header and the footer slot in the last bytes of the
+    // block
+    auto page_size = static_cast<uintptr_t>(getpagesize());
+    auto start = (reinterpret_cast<uintptr_t>(
+                FreeBlockOrder::hook(header_ptr) + 1) + page_size - 1)
+        & ~(page_size - 1);
+    auto end = (reinterpret_cast<uintptr_t>(next_block(header_ptr))
+            - sizeof(int)) & ~(page_size - 1);
+    auto length = (end > start) ? static_cast<int>(end - start) : 0;
+    return std::make_pair(reinterpret_cast<void*>(start), length);
+}
+
+int purgeable_pages(Header_t* header_ptr) {
+    return purgeable_region(header_ptr).second / getpagesize();
+}
+
+} // namespace eecs281
@@ -0,0 +1,272 @@
+/**
+ * @file block.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the layout of the blocks that the allocator hands out
+ * and the functions that split, merge and tag them.  Every block starts with
+ * a header, which is a node of a transparent linked list so that the block
+ * can be linked into a free list without any other memory, and the header
+ * contains a boundary tag that describes the block.  A free block that is
+ * too large for the exact bins is kept in a size ordered tree instead, its
+ * links in the tree are stored in the block's memory right after its header
+ *
+ * These functions only ever touch the block(s) that are passed in and the
+ * boundary tags of their physical neighbours, so synchronizing access to
+ * the blocks is left to the caller
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "IntrusiveTree.hpp"
+#include "TransparentList.hpp"
+
+namespace eecs281 {
+
+/**
+ * The record of a sampled allocation, see profiler.hpp
+ */
+struct Sample;
+
+/**
+ * The boundary tag that is stored in every header.  The size is the number
+ * of usable bytes that follow the header and the flags record whether the
+ * block itself and the block physically before it are in use.  Together
+ * with the size that a free block writes into its last bytes (its footer)
+ * this lets free() find and merge both physical neighbours of a block in
+ * constant time, without an address ordered list
+ *
+ * The arena is the index of the arena that the block was carved out of,
+ * blocks are always freed back into the arena that they came from
+ *
+ * The sample is the record of the block in the heap profile, it is null
+ * unless the block is in use and marked as SAMPLED.  Unlike the flags it is
+ * never written by a neighbour, so the owner of the block can read it
+ * without the arena's lock.  It takes up what would otherwise be padding in
+ * the header
+ */
+struct BlockMetadata {
+    int size;
+    std::uint16_t flags;
+    std::uint16_t arena;
+    Sample* sample;
+};
+
+/**
+ * The flags in the boundary tag
+ *
+ * IN_USE is set when the block has been handed out to the user (or is the
+ * fence at the end of a chunk of memory from the operating system) and
+ * PREV_IN_USE is set when the block right before this one is in use or when
+ * there is no block before this one in its chunk.  The footer of the block
+ * before is only valid when PREV_IN_USE is not set
+ *
+ * MAPPED is set when the block has a mapping from the operating system all
+ * to itself, such a block belongs to no arena and has no neighbours, it is
+ * given back to the operating system as soon as it is freed
+ *
+ * PURGED is set on a free block when the whole pages inside it have been
+ * given back to the operating system with madvise(2), the pages fault back
+ * in (filled with zeros) when the block is used again
+ *
+ * ZEROED is set on a block whose memory has not been written to since it
+ * was fetched from the operating system, so it is still all zeros except
+ * for the footer slot in its last bytes.  The remainder of a split ZEROED
+ * block is ZEROED as well, and an in use block keeps the bit that it was
+ * handed out with until it is freed, which is how calloc() knows that it
+ * can skip clearing the memory.  The tree links that a large free block
+ * keeps in its memory are cleared when a ZEROED block leaves the tree
+ *
+ * SAMPLED is set on an in use block that was picked by the heap profiler,
+ * the block's sample is dropped from the profile when the block is freed
+ */
+constexpr std::uint16_t IN_USE = 0x1;
+constexpr std::uint16_t PREV_IN_USE = 0x2;
+constexpr std::uint16_t MAPPED = 0x4;
+constexpr std::uint16_t PURGED = 0x8;
+constexpr std::uint16_t ZEROED = 0x10;
+constexpr std::uint16_t SAMPLED = 0x20;
+
+/**
+ * Typedefs for the list and header for readability
+ */
+using FreeList_t = TransparentList<BlockMetadata>;
+using Header_t = TransparentNode<BlockMetadata>;
+
+/**
+ * assert that the alignment of the header is the maximum alignment of the
+ * system
+ */
+static_assert(alignof(Header_t) == alignof(std::max_align_t),
+        "Cannot work with a header class that is not aligned to the right "
+        "system boundary");
+static_assert(sizeof(Header_t) == 2 * alignof(std::max_align_t),
+        "The boundary tag should fit in the header without growing it");
+
+/**
+ * The links of a free block in the tree of large free blocks, and the
+ * traits that tell the tree where the links of a block are and how blocks
+ * are ordered.  Blocks are ordered by their size and then by their address,
+ * so the first block that is large enough for a request is the best fit
+ * and the lowest one in memory among the blocks of that size
+ */
+using TreeHook_t = IntrusiveTreeHook<Header_t>;
+
+struct FreeBlockOrder {
+    static TreeHook_t* hook(Header_t* header_ptr) {
+        return reinterpret_cast<TreeHook_t*>(header_ptr + 1);
+    }
+    static bool before(const Header_t* one, const Header_t* two) {
+        return one->datum.size < two->datum.size
+            || (one->datum.size == two->datum.size && one < two);
+    }
+};
+
+using FreeTree_t = IntrusiveTree<Header_t, FreeBlockOrder>;
+
+/**
+ * Asserts the alignment of the passed in pointer value.  The maximum
+ * alignment is determined by the alignment of the library type provided
+ * with the maximum primitive alignment value (std::max_align_t)
+ *
+ * This function can be used both with pointers as well as integral values.
+ * The two overloads take care of seeing whether the pointer or the integer
+ * are divisible by the maximum alignment on the system, there is no good way
+ * in C++ to cast both a pointer or a signed integer to an unsigned value,
+ * reinterpret_cast is only used for bit-wise conversions and static_cast
+ * does not work on pointers
+ */
+template <typename Type>
+bool boundary_aligned(Type* pointer) {
+    return !(reinterpret_cast<std::uintptr_t>(pointer)
+            % alignof(std::max_align_t));
+}
+
+template <typename IntegralType>
+bool boundary_aligned(IntegralType integer) {
+    return !(integer % alignof(std::max_align_t));
+}
+
+/**
+ * Constructs a header starting at address address and extending till the
+ * location as specified by amount and returns the aligned pointer to the
+ * header
+ *
+ * Fails with an abort if either address or amount are not divisible by the
+ * maximum alignment on the system
+ *
+ * @param address The address at which to construct the header
+ * @param amount The amount of memory that will be taken up by the block
+ *        following the header
+ *
+ * @return returns a pointer to the formed header in the memory address
+ *         specified.  If the header can not fit in the memory location given
+ *         then the function returns a nullptr
+ */
+Header_t* make_header(void* address, int amount);
+
+/**
+ * Removes the requested memory from the header and returns a pointer to
+ * whatever was left in the new header, if nothing is left, then this returns
+ * a nullptr
+ *
+ * Returns the same pointer if it has enough memory to fit the amount but not
+ * more than the amount requested.  Returns a pointer that is not equal to
+ * the original pointer if there is enough space in the header to accomodate
+ * another header if possible
+ *
+ * @param header_ptr a pointer to the header from which you want to remove
+ *        memory, another header that is amount + sizeof(Header_t) bytes from
+ *        the passed header will be returned if there is memory for it
+ *
+ * @return If the header cannot be used for the amount of bytes given in the
+ *         second parameter then a nullptr will be returned.  If there is
+ *         just enough memory in the header then the same pointer will be
+ *         returned
+ */
+Header_t* remove_memory(Header_t* header_ptr, int amount);
+
+/**
+ * Coalesces two blocks and then returns the coalesced block to the user, if
+ * they cannot be coalesced then this function returns a nullptr
+ *
+ * @param header_one the first header to be coalesced
+ * @param header_two the second header to be coalesced
+ *
+ * @return returns a pointer to the header formed by coalescing the two
+ *         headers in the parameter pack, if they cannot be coalesced then it
+ *         returns a nullptr
+ */
+Header_t* coalesce(Header_t* header_one, Header_t* header_two);
+
+/**
+ * Return the header of the block that is physically right after and right
+ * before the passed block respectively.  The block before can only be found
+ * when it is free, since its size is read from its footer
+ */
+Header_t* next_block(Header_t* header_ptr);
+Header_t* previous_block(Header_t* header_ptr);
+
+/**
+ * Mark a block as in use or as free.  These update the boundary tags at both
+ * ends of the block, i.e. the flags in the header, the footer of a free
+ * block and the PREV_IN_USE bit of the block right after it
+ */
+void mark_in_use(Header_t* header_ptr);
+void mark_free(Header_t* header_ptr);
+
+/**
+ * Turns a chunk of memory fetched from the operating system into a free
+ * block followed by a fence.  The fence is a header with no memory after it
+ * that is always in use, so the last block in the chunk is never coalesced
+ * past the end of the chunk, similarly the first block in the chunk is
+ * marked as having an in use block before it.  The block is marked as
+ * ZEROED since memory from the operating system is always zero filled
+ *
+ * @param memory the memory and its length as returned by extend_heap()
+ * @param arena the index of the arena that the chunk belongs to
+ *
+ * @return the header of the free block spanning the chunk
+ */
+Header_t* make_chunk(std::pair<void*, int> memory, int arena);
+
+/**
+ * Turns a mapping fetched from the operating system into a single in use
+ * block that spans the whole mapping and is tagged as MAPPED
+ *
+ * @param memory the memory and its length as returned by extend_heap()
+ *
+ * @return the header of the block
+ */
+Header_t* make_mapped_block(std::pair<void*, int> memory);
+
+/**
+ * Returns the mapping that a MAPPED block lies in, this is the page aligned
+ * range of memory that starts at or right before the header and ends at the
+ * end of the block
+ *
+ * @param header_ptr the header of a block tagged as MAPPED
+ *
+ * @return a pair of the start of the mapping and its length
+ */
+std::pair<void*, int> mapped_region(Header_t* header_ptr);
+
+/**
+ * Returns the whole pages that lie inside the block and the number of those
+ * pages respectively.  The pages do not include the page with the header
+ * and the tree links after it or the page with the footer, so they can be
+ * purged while the block is free without disturbing its boundary tags or
+ * its place in the tree
+ *
+ * @param header_ptr the header of the block
+ *
+ * @return a pair of the start of the first whole page and the length of the
+ *         pages in bytes, the length is 0 if there are no whole pages
+ */
+std::pair<void*, int> purgeable_region(Header_t* header_ptr);
+int purgeable_pages(Header_t* header_ptr);
+
+} // namespace eecs281
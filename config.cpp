@@ -0,0 +1,111 @@
+#include <cstdlib>
+#include <climits>
+#include <cerrno>
+#include <unistd.h>
+
+#include "config.hpp"
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * The number of arenas created for every online core when the number of
+     * arenas is not set in the environment
+     */
+    constexpr auto ARENAS_PER_CORE = 4;
+
+    /**
+     * The default and minimum size of a request that gets its own mapping,
+     * smaller mappings would waste most of a page on every request
+     */
+    constexpr auto DEFAULT_MMAP_THRESHOLD = 128 * 1024;
+    constexpr auto MINIMUM_MMAP_THRESHOLD = 4096;
+
+    /**
+     * The default time over which dirty pages are purged, this is the same
+     * as the default dirty decay time of jemalloc
+     */
+    constexpr auto DEFAULT_DECAY_TIME = 10000;
+
+    /**
+     * The default and minimum number of records in the ring of a trace file
+     */
+    constexpr auto DEFAULT_TRACE_RECORDS = 1 << 20;
+    constexpr auto MINIMUM_TRACE_RECORDS = 4096;
+
+    /**
+     * Reads an integer from the environment variable with the given name,
+     * returns the default value if the variable is not set or if it is not a
+     * number in the range [minimum, maximum]
+     */
+    long read_integer(const char* name, long default_value, long minimum,
+                      long maximum);
+
+    /**
+     * Reads all the settings from the environment
+     */
+    Config read_config();
+
+} // namespace <anonymous>
+
+
+const Config& config() {
+    static const auto settings = read_config();
+    return settings;
+}
+
+namespace {
+
+    long read_integer(const char* name, long default_value, long minimum,
+                      long maximum) {
+        auto value = std::getenv(name);
+        if (!value || !*value) {
+            return default_value;
+        }
+
+        // the whole string has to be a number for it to be used
+        errno = 0;
+        auto end = static_cast<char*>(nullptr);
+        auto number = std::strtol(value, &end, 10);
+        if (errno || *end || number < minimum || number > maximum) {
+            return default_value;
+        }
+        return number;
+    }
+
+    Config read_config() {
+        auto settings = Config{};
+
+        auto cores = sysconf(_SC_NPROCESSORS_ONLN);
+        cores = (cores > 0) ? cores : 1;
+        settings.number_arenas = static_cast<int>(read_integer(
+                    "EECS281_MALLOC_ARENAS", ARENAS_PER_CORE * cores, 1,
+                    INT_MAX));
+        settings.mmap_threshold = static_cast<int>(read_integer(
+                    "EECS281_MALLOC_MMAP_THRESHOLD", DEFAULT_MMAP_THRESHOLD,
+                    MINIMUM_MMAP_THRESHOLD, INT_MAX));
+        settings.decay_time = static_cast<int>(read_integer(
+                    "EECS281_MALLOC_DECAY_MS", DEFAULT_DECAY_TIME, -1,
+                    INT_MAX));
+        settings.background_purge = read_integer(
+                "EECS281_MALLOC_BACKGROUND_PURGE", 0, 0, 1);
+        settings.huge_pages = static_cast<HugePages>(read_integer(
+                    "EECS281_MALLOC_HUGE_PAGES", 0, 0, 2));
+        settings.sample_interval = static_cast<int>(read_integer(
+                    "EECS281_MALLOC_SAMPLE_BYTES", 0, 0, INT_MAX));
+        settings.cpu_caches = read_integer(
+                "EECS281_MALLOC_CPU_CACHES", 0, 0, 1);
+        auto trace_path = std::getenv("EECS281_MALLOC_TRACE");
+        settings.trace_path = (trace_path && *trace_path) ? trace_path
+            : nullptr;
+        settings.trace_records = static_cast<int>(read_integer(
+                    "EECS281_MALLOC_TRACE_RECORDS", DEFAULT_TRACE_RECORDS,
+                    MINIMUM_TRACE_RECORDS, INT_MAX / 32));
+
+        return settings;
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
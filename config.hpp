@@ -0,0 +1,111 @@
+/**
+ * @file config.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the tunable settings of the allocator.  The settings
+ * are read from the environment the first time that they are needed and are
+ * fixed after that, so that they can be changed for a program without
+ * recompiling it.  Every setting has a default that is used when its
+ * environment variable is not set or cannot be parsed
+ *
+ * The environment is read with getenv(3) and strtol(3) only, neither of
+ * which allocate memory, so the settings can be read from inside malloc()
+ */
+
+#pragma once
+
+namespace eecs281 {
+
+/**
+ * The kinds of pages that the heap can be backed by, NONE uses the system
+ * page size, TRANSPARENT asks the kernel for transparent huge pages and
+ * EXPLICIT maps memory from the pool of reserved huge pages
+ */
+enum class HugePages { NONE = 0, TRANSPARENT = 1, EXPLICIT = 2 };
+
+/**
+ * The settings of the allocator
+ */
+struct Config {
+
+    /**
+     * The number of arenas that threads are spread across, read from
+     * EECS281_MALLOC_ARENAS.  Defaults to four arenas per online core
+     */
+    int number_arenas;
+
+    /**
+     * Requests of at least this many bytes get a mapping from the operating
+     * system all to themselves, which is unmapped as soon as the memory is
+     * freed.  Read from EECS281_MALLOC_MMAP_THRESHOLD, defaults to 128 KiB
+     */
+    int mmap_threshold;
+
+    /**
+     * The time in milliseconds over which the whole pages in free blocks
+     * are purged back to the operating system, the number of dirty pages
+     * that an arena is allowed to keep decays to zero over this time along
+     * a smoothstep curve.  0 purges pages as soon as they are freed and -1
+     * never purges.  Read from EECS281_MALLOC_DECAY_MS, defaults to 10
+     * seconds
+     */
+    int decay_time;
+
+    /**
+     * Whether a background thread purges the arenas as time passes, without
+     * it the arenas are only purged when blocks are freed to them, so an
+     * idle program keeps its dirty pages.  Read from
+     * EECS281_MALLOC_BACKGROUND_PURGE (0 or 1), defaults to off
+     */
+    bool background_purge;
+
+    /**
+     * Whether the heap grows in huge page sized and aligned chunks that are
+     * backed by huge pages, which cuts down on TLB misses for programs that
+     * chase pointers across a large heap.  Purging a part of a transparent
+     * huge page splits it back into regular pages, so a longer decay time
+     * keeps more of the heap on huge pages.  Read from
+     * EECS281_MALLOC_HUGE_PAGES (0, 1 or 2 for the values of HugePages),
+     * defaults to off
+     */
+    HugePages huge_pages;
+
+    /**
+     * The average number of bytes allocated between two allocations that
+     * are sampled for the heap profile, 0 turns the profiler off.  Read from
+     * EECS281_MALLOC_SAMPLE_BYTES, defaults to off (512 KiB is a good value
+     * for production, it samples a few allocations per second in most
+     * programs)
+     */
+    int sample_interval;
+
+    /**
+     * Whether small blocks are cached per CPU rather than per thread, see
+     * cpu_cache.hpp.  The thread caches are still used if the CPU caches are
+     * not supported.  Read from EECS281_MALLOC_CPU_CACHES (0 or 1), defaults
+     * to off
+     */
+    bool cpu_caches;
+
+    /**
+     * The file that every call into the allocator is traced to, the id of
+     * the process is appended to it.  A nullptr turns the tracer off.  Read
+     * from EECS281_MALLOC_TRACE, defaults to off
+     */
+    const char* trace_path;
+
+    /**
+     * The number of records in the ring of the trace file, each record is
+     * 32 bytes.  Read from EECS281_MALLOC_TRACE_RECORDS, defaults to a
+     * little over a million records (32 MiB)
+     */
+    int trace_records;
+};
+
+/**
+ * Returns the settings of the allocator, the first call reads the settings
+ * from the environment
+ */
+const Config& config();
+
+} // namespace eecs281
@@ -0,0 +1,252 @@
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <new>
+#include <unistd.h>
+
+#include "Arena.hpp"
+#include "config.hpp"
+#include "cpu_cache.hpp"
+#include "os_memory.hpp"
+
+// the restartable sequences are written in x86-64 assembly, and need the
+// registration of the C library
+#if defined(__x86_64__) && defined(__has_include)
+#if __has_include(<sys/rseq.h>)
+#include <sys/rseq.h>
+#define EECS281_CPU_CACHES_SUPPORTED 1
+#endif
+#endif
+
+using std::uintptr_t;
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * The cache of one CPU, the count of each bin is the number of blocks in
+     * the front of its array of slots
+     */
+    struct CpuCache {
+        std::uint32_t counts[NUMBER_EXACT_BINS];
+        void* slots[NUMBER_EXACT_BINS][CPU_CACHE_CAPACITY];
+    };
+
+    /**
+     * The caches of all the CPUs one after the other, each starts on a page
+     * of its own so that no two CPUs share a cache line.  The number of CPUs
+     * is the number that the system is configured with, a CPU with a higher
+     * number than that fails every push and pop
+     */
+    uintptr_t caches = 0;
+    std::uint64_t cache_stride = 0;
+    std::uint32_t number_cpus = 0;
+
+    /**
+     * Decides whether the CPU caches are used and maps them if they are
+     */
+    bool set_up_cpu_caches();
+
+#ifdef EECS281_CPU_CACHES_SUPPORTED
+    /**
+     * Returns the restartable sequence area that the C library registered
+     * for the calling thread
+     */
+    struct rseq* thread_rseq();
+#endif
+
+} // namespace <anonymous>
+
+
+bool cpu_caches_enabled() {
+    static const auto enabled = set_up_cpu_caches();
+    return enabled;
+}
+
+#ifdef EECS281_CPU_CACHES_SUPPORTED
+
+// both sequences have the same shape.  The descriptor of the critical
+// section goes in the __rseq_cs section and is stored into the thread's
+// rseq area at 0, the section itself runs from 1 to 2 and ends with the
+// store to the count that commits it.  The abort handler at 4 sits in a
+// section of its own behind the signature that the kernel checks, and
+// starts the sequence over.  A CPU that has no cache or a bin that is empty
+// (or full) leaves the sequence at 5 without storing anything
+
+void* cpu_cache_pop(int index) {
+    assert(cpu_caches_enabled());
+    assert(index >= 0 && index < NUMBER_EXACT_BINS);
+    auto slots = static_cast<std::uint64_t>(offsetof(CpuCache, slots)
+            + index * CPU_CACHE_CAPACITY * sizeof(void*));
+    auto bin = static_cast<std::uint64_t>(index);
+    auto pointer = static_cast<void*>(nullptr);
+    auto cache = uintptr_t{};
+    auto count = std::uint64_t{};
+    auto slot = uintptr_t{};
+    asm volatile(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0, 0\n\t"
+        ".quad 1f, 2f - 1f, 4f\n\t"
+        ".popsection\n\t"
+        "0:\n\t"
+        "leaq 3b(%%rip), %[cache]\n\t"
+        "movq %[cache], %c[cs_offset](%[rseq])\n\t"
+        "1:\n\t"
+        "movl %c[cpu_offset](%[rseq]), %k[cache]\n\t"
+        "cmpl %k[number_cpus], %k[cache]\n\t"
+        "jae 5f\n\t"
+        "imulq %[stride], %[cache]\n\t"
+        "addq %[caches], %[cache]\n\t"
+        "movl (%[cache], %[bin], 4), %k[count]\n\t"
+        "testl %k[count], %k[count]\n\t"
+        "jz 5f\n\t"
+        "subl $1, %k[count]\n\t"
+        "leaq (%[cache], %[slots]), %[slot]\n\t"
+        "movq (%[slot], %[count], 8), %[pointer]\n\t"
+        "movl %k[count], (%[cache], %[bin], 4)\n\t"
+        "2:\n\t"
+        "jmp 6f\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long %c[signature]\n\t"
+        "4:\n\t"
+        "jmp 0b\n\t"
+        ".popsection\n\t"
+        "5:\n\t"
+        "xorl %k[pointer], %k[pointer]\n\t"
+        "6:\n\t"
+        : [pointer] "=&r" (pointer), [cache] "=&r" (cache),
+          [count] "=&r" (count), [slot] "=&r" (slot)
+        : [rseq] "r" (thread_rseq()), [caches] "r" (caches),
+          [stride] "r" (cache_stride), [number_cpus] "r" (number_cpus),
+          [bin] "r" (bin), [slots] "r" (slots),
+          [cs_offset] "i" (offsetof(struct rseq, rseq_cs)),
+          [cpu_offset] "i" (offsetof(struct rseq, cpu_id)),
+          [signature] "i" (RSEQ_SIG)
+        : "memory", "cc");
+    return pointer;
+}
+
+bool cpu_cache_push(int index, void* pointer) {
+    assert(cpu_caches_enabled());
+    assert(index >= 0 && index < NUMBER_EXACT_BINS);
+    auto slots = static_cast<std::uint64_t>(offsetof(CpuCache, slots)
+            + index * CPU_CACHE_CAPACITY * sizeof(void*));
+    auto bin = static_cast<std::uint64_t>(index);
+    auto pushed = 0;
+    auto cache = uintptr_t{};
+    auto count = std::uint64_t{};
+    auto slot = uintptr_t{};
+
+    // the pointer is written to its slot before the commit, a sequence that
+    // is restarted after that has only written to a slot past the count
+    asm volatile(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0, 0\n\t"
+        ".quad 1f, 2f - 1f, 4f\n\t"
+        ".popsection\n\t"
+        "0:\n\t"
+        "leaq 3b(%%rip), %[cache]\n\t"
+        "movq %[cache], %c[cs_offset](%[rseq])\n\t"
+        "1:\n\t"
+        "movl %c[cpu_offset](%[rseq]), %k[cache]\n\t"
+        "cmpl %k[number_cpus], %k[cache]\n\t"
+        "jae 5f\n\t"
+        "imulq %[stride], %[cache]\n\t"
+        "addq %[caches], %[cache]\n\t"
+        "movl (%[cache], %[bin], 4), %k[count]\n\t"
+        "cmpl %[capacity], %k[count]\n\t"
+        "jae 5f\n\t"
+        "leaq (%[cache], %[slots]), %[slot]\n\t"
+        "movq %[pointer], (%[slot], %[count], 8)\n\t"
+        "addl $1, %k[count]\n\t"
+        "movl %k[count], (%[cache], %[bin], 4)\n\t"
+        "2:\n\t"
+        "movl $1, %[pushed]\n\t"
+        "jmp 6f\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long %c[signature]\n\t"
+        "4:\n\t"
+        "jmp 0b\n\t"
+        ".popsection\n\t"
+        "5:\n\t"
+        "xorl %[pushed], %[pushed]\n\t"
+        "6:\n\t"
+        : [pushed] "=&r" (pushed), [cache] "=&r" (cache),
+          [count] "=&r" (count), [slot] "=&r" (slot)
+        : [rseq] "r" (thread_rseq()), [caches] "r" (caches),
+          [stride] "r" (cache_stride), [number_cpus] "r" (number_cpus),
+          [bin] "r" (bin), [slots] "r" (slots), [pointer] "r" (pointer),
+          [capacity] "i" (CPU_CACHE_CAPACITY),
+          [cs_offset] "i" (offsetof(struct rseq, rseq_cs)),
+          [cpu_offset] "i" (offsetof(struct rseq, cpu_id)),
+          [signature] "i" (RSEQ_SIG)
+        : "memory", "cc");
+    return pushed;
+}
+
+#else
+
+void* cpu_cache_pop(int) {
+    assert(false);
+    return nullptr;
+}
+
+bool cpu_cache_push(int, void*) {
+    assert(false);
+    return false;
+}
+
+#endif
+
+namespace {
+
+    bool set_up_cpu_caches() {
+#ifdef EECS281_CPU_CACHES_SUPPORTED
+        // the C library does not register a sequence when the kernel does
+        // not support them or when it is told not to, and the area of a
+        // thread that is not registered has a negative CPU number
+        if (!config().cpu_caches || !__rseq_size
+                || static_cast<std::int32_t>(thread_rseq()->cpu_id) < 0) {
+            return false;
+        }
+        auto cpus = sysconf(_SC_NPROCESSORS_CONF);
+        auto stride = static_cast<long>((sizeof(CpuCache) + getpagesize() - 1)
+                / getpagesize() * getpagesize());
+        if (cpus <= 0 || cpus > INT32_MAX / stride) {
+            return false;
+        }
+
+        // the memory is fresh from the operating system so every count
+        // starts out at zero, and the pages of a CPU that never runs the
+        // program are never touched
+        try {
+            auto memory = extend_heap(static_cast<int>(cpus * stride));
+            caches = reinterpret_cast<uintptr_t>(memory.first);
+        } catch (const std::bad_alloc&) {
+            return false;
+        }
+        cache_stride = static_cast<std::uint64_t>(stride);
+        number_cpus = static_cast<std::uint32_t>(cpus);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+#ifdef EECS281_CPU_CACHES_SUPPORTED
+    struct rseq* thread_rseq() {
+        return reinterpret_cast<struct rseq*>(static_cast<char*>(
+                    __builtin_thread_pointer()) + __rseq_offset);
+    }
+#endif
+
+} // namespace <anonymous>
+
+} // namespace eecs281
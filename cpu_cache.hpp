@@ -0,0 +1,58 @@
+/**
+ * @file cpu_cache.hpp
+ * @author Aaryaman Sagar
+ *
+ * Caches of small blocks that belong to a CPU rather than to a thread, an
+ * alternative to the thread caches in eecs281malloc.cpp.  A thread cache
+ * holds on to its blocks for as long as its thread lives, so a program with
+ * hundreds of mostly idle threads keeps hundreds of caches full of blocks
+ * and a thread that stops allocating strands the blocks it freed.  There is
+ * only one CPU cache for every CPU, so the memory in the caches is bounded
+ * by the number of CPUs no matter how many threads there are
+ *
+ * Every CPU has an array of block pointers for each exact bin size and a
+ * count of the pointers in each array.  Pushing and popping a block is a
+ * restartable sequence (see rseq(2)), a short critical section that reads
+ * the CPU that the thread runs on and commits with a single store to the
+ * count.  If the thread is preempted or migrated before the store the
+ * kernel restarts the sequence from the top, so the caches need no locks
+ * and no atomic instructions
+ *
+ * The caches are used when EECS281_MALLOC_CPU_CACHES is set to 1, the
+ * kernel supports restartable sequences and the C library has registered
+ * one for every thread (glibc does so from version 2.35).  Otherwise the
+ * thread caches are used as before.  The sequences are written for x86-64,
+ * on other architectures the thread caches are always used
+ */
+
+#pragma once
+
+namespace eecs281 {
+
+/**
+ * The number of blocks that the cache of one CPU holds for each bin
+ */
+constexpr auto CPU_CACHE_CAPACITY = 32;
+
+/**
+ * Returns true if the CPU caches are used instead of the thread caches,
+ * this is decided once for the whole program and the first call sets up the
+ * caches
+ */
+bool cpu_caches_enabled();
+
+/**
+ * Pops a block off the cache bin with the given index of the CPU that the
+ * thread runs on and pushes a block onto it respectively.  These should
+ * only be called when cpu_caches_enabled() returns true
+ *
+ * @param index the index of the cache bin, an exact bin index
+ * @param pointer the block to cache
+ *
+ * @return the block, or a nullptr if the cache bin is empty, and true if
+ *         the block was cached or false if the cache bin is full
+ */
+void* cpu_cache_pop(int index);
+bool cpu_cache_push(int index, void* pointer);
+
+} // namespace eecs281
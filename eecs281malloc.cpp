@@ -1,18 +1,26 @@
 #include <cstdint>
-#include <algorithm>
-#include <stdexcept>
+#include <cstddef>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
 #include <limits>
+#include <mutex>
+#include <new>
 #include <utility>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <sys/types.h>
 
-#include "TransparentList.hpp"
+#include "Arena.hpp"
+#include "block.hpp"
+#include "config.hpp"
+#include "cpu_cache.hpp"
 #include "eecs281malloc.hpp"
 #include "os_memory.hpp"
-
-#include <iostream>
+#include "pagemap.hpp"
+#include "profiler.hpp"
+#include "slab.hpp"
+#include "trace.hpp"
 
 using std::uintptr_t;
 using std::max_align_t;
@@ -22,364 +30,1146 @@ namespace eecs281 {
 namespace {
 
     /**
-     * Typedefs for the list and header for readability
+     * Every thread keeps a small cache of blocks that it has recently freed
+     * for each of the exact bin sizes, so most malloc() and free() calls are
+     * served without locking an arena or using atomics at all.  A cached
+     * block stays marked as in use in its arena (or its slab) and the cache
+     * links cached blocks through their first bytes.  A cache that runs
+     * empty is refilled with CACHE_BATCH blocks at once and a cache that is
+     * full is flushed CACHE_BATCH blocks at once, so the lock is amortized
+     * over the batch.  When the CPU caches in cpu_cache.hpp are enabled
+     * they take the place of the blocks in the thread caches, and are
+     * refilled and flushed the same way
      */
-    using FreeList_t = TransparentList<int>;
-    using Header_t = TransparentNode<int>;
+    constexpr auto NUMBER_CACHE_BINS = NUMBER_EXACT_BINS;
+    constexpr auto CACHE_LIMIT = EXACT_BIN_LIMIT;
+    constexpr auto CACHE_CAPACITY = 32;
+    constexpr auto CACHE_BATCH = CACHE_CAPACITY / 2;
+
+    struct CachedBlock {
+        CachedBlock* next;
+    };
 
     /**
-     * assert that the alignment of the header is the maximum alignment of
-     * the system
+     * The states that a thread cache can be in, a cache starts out
+     * uninitialized in every thread, it becomes active the first time it is
+     * used and it is disabled when the thread exits and its cache has been
+     * flushed, after which the thread goes straight to its arena
      */
-    static_assert(alignof(Header_t) == alignof(max_align_t),
-            "Cannot work with a header class that is not aligned to the right "
-            "system boundary");
+    enum class CacheState { UNINITIALIZED, ACTIVE, DISABLED };
 
     /**
-     * A singleton that contains the state required by the memory allocator
+     * The per thread state, the arena is the arena that the thread has been
+     * assigned to, it is assigned the first time that the thread allocates
+     * memory and is where the thread gets all its memory from.  The thread's
+     * counters for the statistics are linked into its arena while the cache
+     * is active.  The thread counts down the number of bytes it has left to
+     * allocate until the heap profiler samples an allocation, the countdown
+     * is started when the cache is set up.  Whether the CPU caches are used
+     * is copied into the cache when it becomes active, so that the fast
+     * paths only read thread local memory
      */
-    FreeList_t free_list;
+    struct ThreadCache {
+        CachedBlock* heads[NUMBER_CACHE_BINS];
+        int counts[NUMBER_CACHE_BINS];
+        CacheState state;
+        bool cpu_caches;
+        Arena* arena;
+        ThreadStatistics statistics;
+        std::int64_t bytes_until_sample;
+    };
 
     /**
-     * Constructs a header starting at address address and extending till the
-     * location as specified by amount and returns the aligned pointer to the
-     * header
-     *
-     * Fails with an abort if either address or amount are not divisible by
-     * the maximum alignment on the system
-     *
-     * @param address The address at which to construct the header
-     * @param amount The amount of memory that will be taken up by the block
-     *        following the header
-     *
-     * @return returns a pointer to the formed header in the memory address
-     *         specified.  If the header can not fit in the memory location
-     *         given then the function returns a nullptr
+     * The cache is trivially destructible so that it can be used by the
+     * thread at any point in its lifetime, the guard is what flushes the
+     * cache back to the arenas when the thread exits
      */
-    Header_t* make_header(void* address, int amount);
+    thread_local ThreadCache thread_cache;
+
+    struct ThreadCacheGuard {
+        ThreadCacheGuard() = default;
+        ~ThreadCacheGuard();
+    };
+    thread_local ThreadCacheGuard thread_cache_guard;
 
     /**
-     * Removes the requested memory from the header and returns a pointer to
-     * whatever was left in the new header, if nothing is left, then this
-     * returns a nullptr
-     *
-     * Returns the same pointer if it has enough memory to fit the amount but
-     * not more than the amount requested.  Returns a pointer that is not
-     * equal to the original pointer if there is enough space in the header to
-     * accomodate another header if possible
-     *
-     * @param header_ptr a pointer to the header from which you want to remove
-     *        memory, another header that is amount + sizeof(Header_t) bytes
-     *        from the passed header will be returned if there is memory for
-     *        it
-     *
-     * @return If the header cannot be used for the amount of bytes given in
-     *         the second parameter then a nullptr will be returned.  If there
-     *         is just enough memory in the header then the same pointer will
-     *         be returned
+     * The number of bytes in the mappings of blocks that have a mapping of
+     * their own and the number of usable bytes in those blocks, these are
+     * the only parts of the statistics that are not kept by an arena
      */
-    Header_t* remove_memory(Header_t* header_ptr, int amount);
+    std::atomic<std::uint64_t> mapped_block_bytes{0};
+    std::atomic<std::uint64_t> mapped_block_usable_bytes{0};
 
     /**
-     * Coalesces two blocks and then returns the coalesced block to the user,
-     * if they cannot be coalesced then this function returns a nullptr
-     *
-     * @param header_one the first header to be coalesced
-     * @param header_two the second header to be coalesced
-     *
-     * @return returns a pointer to the header formed by coalescing the two
-     *         headers in the parameter pack, if they cannot be coalesced then
-     *         it returns a nullptr
+     * The bodies of malloc(), free(), calloc(), realloc(), aligned_alloc(),
+     * malloc_batch() and free_batch(), these are what the allocator calls
+     * internally so that only the calls that are made by the program are
+     * traced.  The amount given to allocate_cleared() has been checked for
+     * overflow and rounded up
      */
-    Header_t* coalesce(Header_t* header_one, Header_t* header_two);
+    EECS281_ALLOCATOR_TEXT
+    void* allocate_memory(int amount);
+    void free_memory(void* address);
+    EECS281_ALLOCATOR_TEXT
+    void* allocate_cleared(int amount);
+    EECS281_ALLOCATOR_TEXT
+    void* reallocate_memory(void* pointer, int amount);
+    EECS281_ALLOCATOR_TEXT
+    void* allocate_aligned_memory(int alignment, int amount);
+    EECS281_ALLOCATOR_TEXT
+    void allocate_batch(int amount, int count, void** pointers);
+    void free_batch_memory(void** pointers, int count);
 
     /**
-     * Insert the header into the linked list in a sorted manner, keeping the
-     * nodes ordered by their address, lower address first then the higher
-     * address
+     * Returns true if the thread's cache can be used, the first call in each
+     * thread makes sure that the cache is flushed when the thread exits and
+     * links the thread's counters into its arena
+     */
+    bool thread_cache_active();
+
+    /**
+     * Returns the arena that the calling thread is assigned to, assigning
+     * one if this is the first time that the thread needs one
+     */
+    Arena& thread_arena();
+
+    /**
+     * Allocates memory for the user from the arena, small requests are
+     * served from the arena's slabs and the rest from its free blocks.  The
+     * arena must be locked
+     */
+    void* allocate_from_arena(Arena& arena, int amount);
+
+    /**
+     * Frees the memory back to the arena that it belongs to, this works with
+     * both slab objects and blocks, the kind is the kind of the memory's
+     * page in the page map.  The arena must be locked
+     */
+    void deallocate_to_arena(Arena& arena, void* address, PageKind kind);
+
+    /**
+     * Refills the cache bin with a batch of blocks from the thread's arena
+     * and flushes a batch of blocks from the cache bin back to the arenas
+     * that they belong to respectively.  A refill locks the arena once for
+     * the whole batch, a flush locks the thread's own arena at most once and
+     * pushes each run of blocks that belong to another arena onto that
+     * arena's remote free stack
      *
-     * @param to_insert the header pointer to insert into the free list
+     * @param index the index of the cache bin to refill or flush
+     * @param count the number of blocks to flush
+     */
+    void refill_cache(int index);
+    void flush_cache(int index, int count);
+
+    /**
+     * Takes a block out of the cache bin with the given index, refilling the
+     * bin from the thread's arena if it is empty.  The cache is the cache of
+     * the CPU that the thread runs on when the CPU caches are enabled and
+     * the thread's own cache otherwise
+     */
+    void* take_cached_block(int index);
+
+    /**
+     * Refills the bin of the CPU cache with a batch of blocks from the
+     * thread's arena and returns one more block from the arena, and flushes
+     * a batch of blocks from the bin of the CPU cache respectively.  The
+     * thread can move to another CPU at any point, so a refill frees the
+     * blocks that no longer fit and a flush might find fewer blocks
+     */
+    void* refill_cpu_cache(int index);
+    void flush_cpu_cache(int index);
+
+    /**
+     * Frees blocks from a cache back to the arenas that they belong to, the
+     * thread's own arena is locked at most once and each run of blocks that
+     * belong to another arena is pushed onto that arena's remote free stack
+     */
+    void release_blocks(void* const* blocks, int count);
+
+    /**
+     * Puts memory into the cache bin with the given index, flushing a batch
+     * of blocks from the bin if it is over capacity.  The memory should be
+     * at least as large as the size of the bin
+     */
+    void cache_block(void* address, int index);
+
+    /**
+     * A chain of memory that is on its way to the remote free stack of an
+     * arena other than the thread's own, so that a run of memory that
+     * belongs to one arena is pushed with a single compare and swap
+     */
+    struct RemoteChain {
+        Arena* arena;
+        RemoteFree* first;
+        RemoteFree* last;
+    };
+
+    /**
+     * Adds memory to the end of the chain, pushing what the chain holds
+     * first if it is for an arena other than the one the memory belongs
+     * to, and pushes the chain onto its arena's stack leaving it empty
+     * respectively
+     */
+    void add_to_chain(RemoteChain& chain, Arena& arena, void* address);
+    void push_chain(RemoteChain& chain);
+
+    /**
+     * Called when the thread's countdown to the next sample has run out,
+     * this starts the next countdown and allocates amount bytes if the
+     * allocation is sampled by the heap profiler.  Sampled memory is always
+     * a block, so that its header can point to its sample
      *
-     * @return returns an iterator that points to the inserted element
+     * @return the sampled memory, or a nullptr if the allocation is not
+     *         sampled in which case it should be served as usual
+     */
+    EECS281_ALLOCATOR_TEXT
+    void* allocate_sampled(int amount);
+
+    /**
+     * Counts an allocation and a free of memory of the given usable size in
+     * the statistics, in the thread's own counters if it has them and in the
+     * thread's arena otherwise.  These must be called without any arena
+     * locked
+     */
+    void count_malloc(int size);
+    void count_free(int size);
+
+    /**
+     * Adds one to a counter that only the calling thread writes to
+     */
+    void increment(std::atomic<std::uint64_t>& counter);
+
+    /**
+     * Adds a block with a mapping of its own to the statistics and to the
+     * page map and takes it out of them respectively
      */
-    FreeList_t::NodeIterator insert_sorted(Header_t* to_insert);
+    void add_mapped_block(Header_t* header_ptr);
+    void remove_mapped_block(Header_t* header_ptr);
 
     /**
-     * Prints the free list, this is a debugging method.  Use this to print
-     * the entire contents of the list
+     * Moves the memory to a new allocation of amount bytes, copying the
+     * lesser of the old size and amount bytes over and freeing the old
+     * memory
      */
-    void print_free_list();
+    EECS281_ALLOCATOR_TEXT
+    void* move_memory(void* address, int old_size, int amount);
+
+    /**
+     * Resizes a block that has a mapping of its own with mremap(2), and
+     * returns the memory of the block at its new address
+     */
+    void* resize_mapped(Header_t* header_ptr, int amount);
 
 } // namespace <anonymous>
 
 
+EECS281_ALLOCATOR_TEXT
 void* malloc(int amount) {
-
-    // round up the amount to the max alignment on the system
-    amount = round_up_to_max_alignment(amount);
-
-    // iterate through the free list and see if a node with the right size can
-    // be found
-    auto iter = std::find_if(free_list.begin(), free_list.end(),
-            [&](auto header_ptr) {
-        return header_ptr->datum > amount;
-    });
-
-    // if there is no block big enough to serve the request then ask the
-    // operating system for more memory and then insert that object into the
-    // linked list
-    if (iter == free_list.end()) {
-        auto memory_amount = extend_heap(amount + sizeof(Header_t));
-        auto header = make_header(memory_amount.first, memory_amount.second);
-        assert(header);
-        assert(header->datum >= amount);
-        iter = insert_sorted(header);
-    }
-
-    // remove the header from the list
-    auto header_to_return = *iter;
-    assert(header_to_return->datum >= amount);
-    free_list.erase(iter);
-
-    // remove the amount of memory that the user had asked for from the
-    // header, if there was more memory left, then reinsert whatever is left
-    // into the linked list of headers
-    auto new_header = remove_memory(header_to_return, amount);
-    assert(new_header);
-    if (new_header != header_to_return) {
-        insert_sorted(new_header);
-    }
-    return static_cast<void*>(header_to_return + 1);
+    auto pointer = allocate_memory(amount);
+    if (trace_enabled()) {
+        trace(TraceOperation::MALLOC, pointer, amount);
+    }
+    return pointer;
 }
 
 void free(void* address) {
-    // get a pointer to the header right before the memory that has to be
-    // freed
-    auto header_ptr = static_cast<Header_t*>(address) - 1;
+    // a free is traced before the memory is freed, so that it comes before
+    // any allocation that gets the same memory
+    if (address && trace_enabled()) {
+        trace(TraceOperation::FREE, address, 0);
+    }
+    free_memory(address);
+}
 
-    // insert back into the free list
-    auto iter = insert_sorted(header_ptr);
-    assert(iter != free_list.end());
+void free_sized(void* address, int size) {
+    if (!address) {
+        return;
+    }
+    if (trace_enabled()) {
+        trace(TraceOperation::FREE, address, size);
+    }
 
-    // check the iterators right before and after it
-    auto before = iter;
-    auto after = iter;
-    --before;
-    ++after;
+    // the memory is at least as large as the size that was asked for, so
+    // it can serve any later request of that size from the cache.  Memory
+    // of a size that is too large for a slab is a block which can be
+    // larger than the size and might have a mapping of its own, that can
+    // only be told from its header.  So can a block that was sampled by the
+    // heap profiler, so the size is not used while the profiler is on
+    auto amount = round_up_to_max_alignment(std::max(size, 1));
+    assert(amount <= malloc_usable_size(address));
+    if (amount <= SLAB_LIMIT && !config().sample_interval
+            && thread_cache_active()) {
+        auto index = bin_index(amount);
+        increment(thread_cache.statistics.frees[index]);
+        cache_block(address, index);
+        return;
+    }
+    free_memory(address);
+}
 
-    // coalesce with the block before if possible
-    if (before != free_list.end()) {
-        auto coalesced_header_ptr = coalesce(*before, *iter);
-        if (coalesced_header_ptr) {
-            free_list.erase(iter);
-            free_list.erase(before);
+EECS281_ALLOCATOR_TEXT
+void* calloc(int number, int size) {
+    if (number < 0 || size < 0
+            || (number && size > std::numeric_limits<int>::max() / number)) {
+        throw std::bad_alloc{};
+    }
+    auto amount = round_up_to_max_alignment(std::max(number * size, 1));
+    auto pointer = allocate_cleared(amount);
+    if (trace_enabled()) {
+        trace(TraceOperation::CALLOC, pointer, number * size);
+    }
+    return pointer;
+}
 
-            // reset the iter value to be the iterator that points to the
-            // inserted element
-            iter = insert_sorted(coalesced_header_ptr);
+EECS281_ALLOCATOR_TEXT
+void* realloc(void* pointer, int amount) {
+    // the old memory can be freed before realloc returns, so the record is
+    // stamped before that for the same reason that a free is traced first
+    auto record = static_cast<TraceRecord*>(nullptr);
+    if (trace_enabled()) {
+        record = trace_start(amount, reinterpret_cast<uintptr_t>(pointer));
+    }
+    auto resized = reallocate_memory(pointer, amount);
+    trace_finish(record, TraceOperation::REALLOC, resized);
+    return resized;
+}
+
+EECS281_ALLOCATOR_TEXT
+void* aligned_alloc(int alignment, int amount) {
+    auto pointer = allocate_aligned_memory(alignment, amount);
+    if (pointer && trace_enabled()) {
+        trace(TraceOperation::ALIGNED_ALLOC, pointer, amount,
+                static_cast<std::uint64_t>(alignment));
+    }
+    return pointer;
+}
+
+EECS281_ALLOCATOR_TEXT
+void malloc_batch(int amount, int count, void** pointers) {
+    allocate_batch(amount, count, pointers);
+    if (trace_enabled()) {
+        for (auto i = 0; i < count; ++i) {
+            trace(TraceOperation::MALLOC, pointers[i], amount);
         }
     }
+}
 
-    // coalesce with the block after is possible, this might include the
-    // coalesced block from the previous if block
-    if (after != free_list.end()) {
-        auto coalesced_header_ptr = coalesce(*after, *iter);
-        if (coalesced_header_ptr) {
-            free_list.erase(iter);
-            free_list.erase(after);
-            insert_sorted(coalesced_header_ptr);
+void free_batch(void** pointers, int count) {
+    if (trace_enabled()) {
+        for (auto i = 0; i < count; ++i) {
+            if (pointers[i]) {
+                trace(TraceOperation::FREE, pointers[i], 0);
+            }
         }
     }
+    free_batch_memory(pointers, count);
+}
+
+EECS281_ALLOCATOR_TEXT
+int posix_memalign(void** pointer, int alignment, int amount) {
+    if (alignment <= 0 || (alignment & (alignment - 1))
+            || alignment % static_cast<int>(sizeof(void*))) {
+        return EINVAL;
+    }
+    try {
+        *pointer = aligned_alloc(alignment, amount);
+    } catch (const std::bad_alloc&) {
+        return ENOMEM;
+    }
+    return 0;
+}
+
+int malloc_usable_size(void* pointer) {
+    auto entry = page_entry(pointer);
+    assert(entry.kind != PageKind::NONE);
+    if (entry.kind == PageKind::SLAB) {
+        return static_cast<Slab_t*>(entry.descriptor)->datum.object_size;
+    }
+    return (static_cast<Header_t*>(pointer) - 1)->datum.size;
+}
+
+PurgeStatistics purge_statistics() {
+    auto statistics = PurgeStatistics{0, 0};
+    for (auto index = 0; index < number_arenas(); ++index) {
+        auto& arena = arena_from_index(index);
+        std::lock_guard<Arena> lock{arena};
+        statistics.pages_purged += arena.pages_purged();
+        statistics.pages_reused += arena.pages_reused();
+    }
+    return statistics;
+}
+
+Statistics statistics() {
+    auto statistics = Statistics{};
+    for (auto index = 0; index < number_arenas(); ++index) {
+        auto& arena = arena_from_index(index);
+        std::lock_guard<Arena> lock{arena};
+        arena.drain_remote_frees();
+        arena.add_statistics(statistics);
+    }
+    statistics.mapped_bytes += mapped_block_bytes.load(
+            std::memory_order_relaxed);
+    statistics.allocated_bytes += mapped_block_usable_bytes.load(
+            std::memory_order_relaxed);
+    for (auto index = 0; index < NUMBER_SIZE_CLASSES; ++index) {
+        statistics.size_classes[index].maximum_size = bin_maximum_size(index);
+    }
+    return statistics;
 }
 
 
 namespace {
 
-    /**
-     * Asserts the alignment of the passed in pointer value.  The maximum
-     * alignment is determined by the alignment of the library type provided
-     * with the maximum primitive alignment value (std::max_align_t)
-     *
-     * This function can be used both with pointers as well as integral
-     * values.  The two overloads take care of seeing whether the pointer or
-     * the integer are divisible by the maximum alignment on the system, there
-     * is no good way in C++ to cast both a pointer or a signed integer to an
-     * unsigned value, reinterpret_cast is only used for bit-wise conversions
-     * and static_cast does not work on pointers
-     */
-    template <typename Type>
-    bool boundary_aligned(Type* pointer) {
-        return !(reinterpret_cast<uintptr_t>(pointer) % alignof(max_align_t));
+    void* allocate_memory(int amount) {
+
+        // like malloc(3) a request for no memory returns memory that can be
+        // freed, so it is served at the smallest size.  A negative amount
+        // can never be served.  Then round up the amount to the max
+        // alignment on the system
+        if (amount < 0) {
+            throw std::bad_alloc{};
+        }
+        amount = round_up_to_max_alignment(std::max(amount, 1));
+
+        // an allocation that is not sampled by the heap profiler only counts
+        // down to the next sample
+        thread_cache.bytes_until_sample -= amount;
+        if (thread_cache.bytes_until_sample < 0) {
+            if (auto pointer = allocate_sampled(amount)) {
+                return pointer;
+            }
+        }
+
+        // small requests are served from the thread's cache (or the CPU's)
+        // when possible, this path takes no locks
+        if (amount <= CACHE_LIMIT && thread_cache_active()) {
+            auto index = bin_index(amount);
+            auto block = take_cached_block(index);
+
+            // a cached block that is too large for a slab can be a little
+            // larger than the size of its cache bin, it is counted in the class
+            // of its real size so that it is freed from the class that it was
+            // allocated from
+            auto size_class = (amount > SLAB_LIMIT)
+                ? bin_index((reinterpret_cast<Header_t*>(block)
+                            - 1)->datum.size)
+                : index;
+            increment(thread_cache.statistics.mallocs[size_class]);
+            return block;
+        }
+
+        // large requests bypass the arenas and get their own mapping
+        if (amount >= config().mmap_threshold) {
+            auto header_ptr = make_mapped_block(extend_heap(
+                        amount + static_cast<int>(sizeof(Header_t))));
+            add_mapped_block(header_ptr);
+            count_malloc(header_ptr->datum.size);
+            return static_cast<void*>(header_ptr + 1);
+        }
+
+        auto pointer = static_cast<void*>(nullptr);
+        {
+            auto& arena = thread_arena();
+            std::lock_guard<Arena> lock{arena};
+            pointer = allocate_from_arena(arena, amount);
+        }
+        count_malloc(malloc_usable_size(pointer));
+        return pointer;
+    }
+
+    void free_memory(void* address) {
+        if (!address) {
+            return;
+        }
+
+        // the page map says what the memory is before anything around it is
+        // read, memory that did not come from the allocator is left alone.
+        // Small objects have no header, their size is that of the objects in
+        // their slab, for everything else the size is in the header right
+        // before the memory that has to be freed
+        auto entry = page_entry(address);
+        assert(entry.kind != PageKind::NONE);
+        if (entry.kind == PageKind::NONE) {
+            return;
+        }
+        auto is_slab = (entry.kind == PageKind::SLAB);
+        auto header_ptr = static_cast<Header_t*>(address) - 1;
+        auto size = is_slab
+            ? static_cast<Slab_t*>(entry.descriptor)->datum.object_size
+            : header_ptr->datum.size;
+
+        // a sampled block leaves the heap profile, and it bypasses the cache so
+        // that its flag is cleared when it is freed to its arena.  The sample
+        // is read rather than the flags, which the arena's lock guards
+        auto sampled = !is_slab && header_ptr->datum.sample;
+        if (sampled) {
+            drop_sample(header_ptr->datum.sample);
+        }
+
+        // a block with its own mapping is given back to the operating system
+        // right away
+        if (entry.kind == PageKind::MAPPED) {
+            assert(entry.descriptor == header_ptr);
+            assert(header_ptr->datum.flags & MAPPED);
+            remove_mapped_block(header_ptr);
+            count_free(size);
+            auto region = mapped_region(header_ptr);
+            release_heap(region.first, region.second);
+            return;
+        }
+
+        // small blocks go into the thread's cache, this might flush some cached
+        // blocks back to their arenas if the cache bin is full
+        if (size <= CACHE_LIMIT && !sampled && thread_cache_active()) {
+            auto index = bin_index(size);
+            increment(thread_cache.statistics.frees[index]);
+            cache_block(address, index);
+            return;
+        }
+
+        // otherwise the block goes straight back to the arena it came from,
+        // without taking its lock if it is not the thread's own arena
+        auto& arena = arena_from_index(entry.arena);
+        if (&arena != &thread_arena()) {
+            auto node = static_cast<RemoteFree*>(address);
+            arena.free_remote(node, node);
+        } else {
+            std::lock_guard<Arena> lock{arena};
+            deallocate_to_arena(arena, address, entry.kind);
+        }
+        count_free(size);
+        start_background_purge();
     }
 
-    template <typename IntegralType>
-    bool boundary_aligned(IntegralType integer) {
-        return !(integer % alignof(max_align_t));
+    void* allocate_cleared(int amount) {
+        // small memory is likely to have been used before and is cheap to
+        // clear, and a mapping of its own is always fresh from the operating
+        // system
+        if (amount <= CACHE_LIMIT) {
+            auto pointer = allocate_memory(amount);
+            std::memset(pointer, 0, amount);
+            return pointer;
+        }
+        if (amount >= config().mmap_threshold) {
+            return allocate_memory(amount);
+        }
+        thread_cache.bytes_until_sample -= amount;
+        if (thread_cache.bytes_until_sample < 0) {
+            if (auto pointer = allocate_sampled(amount)) {
+                std::memset(pointer, 0, malloc_usable_size(pointer));
+                return pointer;
+            }
+        }
+
+        // the zeroed bit has to be read while the arena is locked since the
+        // neighbours of the block can change the other bits of its flags
+        auto header_ptr = static_cast<Header_t*>(nullptr);
+        auto zeroed = false;
+        {
+            auto& arena = thread_arena();
+            std::lock_guard<Arena> lock{arena};
+            header_ptr = arena.allocate(amount);
+            zeroed = header_ptr->datum.flags & ZEROED;
+        }
+        count_malloc(header_ptr->datum.size);
+
+        // a block that is still zero has at most its footer slot written to
+        auto pointer = static_cast<void*>(header_ptr + 1);
+        if (zeroed) {
+            std::memset(static_cast<char*>(pointer) + header_ptr->datum.size
+                    - sizeof(int), 0, sizeof(int));
+        } else {
+            std::memset(pointer, 0, header_ptr->datum.size);
+        }
+        return pointer;
     }
 
-    Header_t* make_header(void* address, int amount) {
-        assert(boundary_aligned(address));
-        assert(boundary_aligned(amount));
-        assert(boundary_aligned(sizeof(Header_t)));
+    void* reallocate_memory(void* pointer, int amount) {
+        if (amount < 0) {
+            throw std::bad_alloc{};
+        }
+        if (!pointer) {
+            return allocate_memory(amount);
+        }
+        if (!amount) {
+            free_memory(pointer);
+            return nullptr;
+        }
+        amount = round_up_to_max_alignment(amount);
+
+        // a slab object can only stay where it is if it fits in its slot
+        auto entry = page_entry(pointer);
+        assert(entry.kind != PageKind::NONE);
+        if (entry.kind == PageKind::SLAB) {
+            auto object_size = static_cast<Slab_t*>(
+                    entry.descriptor)->datum.object_size;
+            if (amount <= object_size) {
+                return pointer;
+            }
+            return move_memory(pointer, object_size, amount);
+        }
+
+        // a block with a mapping of its own is remapped as long as it stays
+        // large enough to deserve its own mapping.  The page map says so
+        // rather than the flags, which the arena's lock guards
+        auto header_ptr = static_cast<Header_t*>(pointer) - 1;
+        auto old_size = header_ptr->datum.size;
+        if (entry.kind == PageKind::MAPPED) {
+            if (amount >= config().mmap_threshold) {
+                auto resized = resize_mapped(header_ptr, amount);
+                count_free(old_size);
+                count_malloc(malloc_usable_size(resized));
+                return resized;
+            }
+            return move_memory(pointer, old_size, amount);
+        }
 
-        // if the header cannot serve any memory request then return a nullptr
-        // to indicate that the header is not suitable for usage
-        if (amount <= static_cast<int>(sizeof(Header_t))) {
+        // otherwise try to resize the block in place in the arena it belongs
+        // to, the size of the block is left alone if that does not work.  A
+        // resized block is counted as a free of the old size and an allocation
+        // of the new size
+        auto resized = false;
+        {
+            auto& arena = arena_from_index(header_ptr->datum.arena);
+            std::lock_guard<Arena> lock{arena};
+            resized = arena.reallocate(header_ptr, amount);
+        }
+        if (resized) {
+            if (header_ptr->datum.size != old_size) {
+                count_free(old_size);
+                count_malloc(header_ptr->datum.size);
+            }
+            return pointer;
+        }
+        return move_memory(pointer, old_size, amount);
+    }
+
+    void* allocate_aligned_memory(int alignment, int amount) {
+        if (alignment <= 0 || (alignment & (alignment - 1))) {
             return nullptr;
         }
+        if (amount < 0) {
+            throw std::bad_alloc{};
+        }
+        if (alignment <= static_cast<int>(alignof(max_align_t))) {
+            return allocate_memory(amount);
+        }
 
-        // set the size variable in the header to be the previous size minus
-        // the amount that is needed for the header, this will still result in
-        // the address range being aligned since the node type's alignment has
-        // been set to the maximum alignment on the system (i.e.
-        // alignof(std::max_align_t)
-        auto new_size = static_cast<int>(amount - sizeof(Header_t));
-        auto header_ptr = new(address) Header_t{new_size};
-        return header_ptr;;
+        // with the size rounded up to a multiple of the alignment every object
+        // in a slab is aligned, since the objects are packed right after the
+        // slab descriptor.  This skips the thread's cache since the cached
+        // blocks are not all aligned
+        amount = std::max(amount, 1);
+        amount = (amount + alignment - 1) & ~(alignment - 1);
+        static_assert(!(sizeof(Slab_t) & (sizeof(Slab_t) - 1)),
+                "Slab objects are only aligned if the descriptor size is a "
+                "power of two");
+        if (amount <= SLAB_LIMIT
+                && alignment <= static_cast<int>(sizeof(Slab_t))) {
+            auto pointer = static_cast<void*>(nullptr);
+            {
+                auto& arena = thread_arena();
+                std::lock_guard<Arena> lock{arena};
+                pointer = arena.allocate_small(amount);
+            }
+            count_malloc(amount);
+            return pointer;
+        }
+
+        // a large request gets its own mapping with the header placed so that
+        // the memory right after it is aligned, this only works while the
+        // header is still on the first page of the mapping
+        if (amount >= config().mmap_threshold && alignment <= getpagesize()) {
+            auto memory = extend_heap(amount + alignment);
+            auto offset = alignment - static_cast<int>(sizeof(Header_t));
+            auto header_ptr = make_mapped_block(std::make_pair(
+                        static_cast<void*>(static_cast<char*>(memory.first)
+                            + offset), memory.second - offset));
+            add_mapped_block(header_ptr);
+            count_malloc(header_ptr->datum.size);
+            return static_cast<void*>(header_ptr + 1);
+        }
+
+        auto header_ptr = static_cast<Header_t*>(nullptr);
+        {
+            auto& arena = thread_arena();
+            std::lock_guard<Arena> lock{arena};
+            header_ptr = arena.allocate_aligned(alignment, amount);
+        }
+        count_malloc(header_ptr->datum.size);
+        return static_cast<void*>(header_ptr + 1);
     }
 
-    Header_t* remove_memory(Header_t* header_ptr, int amount) {
-        assert(header_ptr);
-        assert(boundary_aligned(header_ptr));
-        assert(boundary_aligned(amount));
-        assert(boundary_aligned(header_ptr->datum));
+    void allocate_batch(int amount, int count, void** pointers) {
+        assert(count >= 0);
+        amount = round_up_to_max_alignment(std::max(amount, 1));
+        std::fill(pointers, pointers + count, nullptr);
 
-        // if the header does not contain enough memory for the amount to be
-        // reduced then return nullptr
-        if (header_ptr->datum < amount) {
-            return nullptr;
+        // the heap profiler samples single allocations and large memory gets
+        // a mapping of its own, so those batches are served one at a time.
+        // Memory that was allocated before an allocation fails is freed
+        // again so that the batch allocates all or nothing
+        auto index = 0;
+        try {
+            if (config().sample_interval
+                    || amount >= config().mmap_threshold) {
+                for (; index < count; ++index) {
+                    pointers[index] = allocate_memory(amount);
+                }
+                return;
+            }
+
+            // small memory is taken from the thread's cache while it lasts,
+            // this is counted like any other allocation from the cache
+            if (amount <= CACHE_LIMIT && thread_cache_active()) {
+                auto bin = bin_index(amount);
+                for (; index < count && thread_cache.heads[bin]; ++index) {
+                    auto block = thread_cache.heads[bin];
+                    thread_cache.heads[bin] = block->next;
+                    --thread_cache.counts[bin];
+                    auto size_class = (amount > SLAB_LIMIT)
+                        ? bin_index((reinterpret_cast<Header_t*>(block)
+                                    - 1)->datum.size)
+                        : bin;
+                    increment(thread_cache.statistics.mallocs[size_class]);
+                    pointers[index] = static_cast<void*>(block);
+                }
+            }
+            if (index < count) {
+                auto& arena = thread_arena();
+                std::lock_guard<Arena> lock{arena};
+                arena.allocate_batch(amount, count - index, pointers + index);
+            }
+        } catch (const std::bad_alloc&) {
+            for (auto i = index; i < count && pointers[i]; ++i) {
+                count_malloc(malloc_usable_size(pointers[i]));
+            }
+            free_batch_memory(pointers, count);
+            std::fill(pointers, pointers + count, nullptr);
+            throw;
         }
+        for (; index < count; ++index) {
+            count_malloc(malloc_usable_size(pointers[index]));
+        }
+    }
 
-        // attempt to create another header from the current header, if there
-        // is enough memory for another header then one will be created
-        auto new_header = make_header(reinterpret_cast<void*>(
-                    reinterpret_cast<uintptr_t>(header_ptr + 1) + amount),
-                header_ptr->datum - amount);
-        if (new_header) {
-            assert(boundary_aligned(new_header));
-            assert(boundary_aligned(new_header->datum));
+    void free_batch_memory(void** pointers, int count) {
+        assert(count >= 0);
 
-            // change the amount of memory right after the old header to be
-            // the amount that was requested
-            header_ptr->datum = amount;
-            return new_header;
+        // sorting puts the memory of each arena in address order, nullptrs
+        // end up at the front.  Blocks with a mapping of their own are freed
+        // one at a time and everything else is counted and has its sample
+        // dropped before any arena is locked, what is left is packed into
+        // the front of the array
+        std::sort(pointers, pointers + count);
+        auto number_left = 0;
+        for (auto i = 0; i < count; ++i) {
+            auto address = pointers[i];
+            if (!address) {
+                continue;
+            }
+            auto entry = page_entry(address);
+            assert(entry.kind != PageKind::NONE);
+            if (entry.kind == PageKind::NONE) {
+                continue;
+            }
+            if (entry.kind == PageKind::MAPPED) {
+                free_memory(address);
+                continue;
+            }
+            auto header_ptr = static_cast<Header_t*>(address) - 1;
+            if (entry.kind == PageKind::SLAB) {
+                count_free(static_cast<Slab_t*>(
+                            entry.descriptor)->datum.object_size);
+            } else {
+                // the sample is read rather than the flags, for the same
+                // reason as in free_memory()
+                if (header_ptr->datum.sample) {
+                    drop_sample(header_ptr->datum.sample);
+                }
+                count_free(header_ptr->datum.size);
+            }
+            pointers[number_left++] = address;
         }
 
-        // else return the same pointer to indicate that it can serve the
-        // request but not more than it
-        return header_ptr;
+        // then each run of memory that belongs to one arena and is of one
+        // kind is freed under a single lock if it is the thread's own arena,
+        // and pushed onto the arena's remote free stack at once otherwise
+        auto& own = thread_arena();
+        auto lock = std::unique_lock<Arena>{own, std::defer_lock};
+        auto chain = RemoteChain{nullptr, nullptr, nullptr};
+        for (auto first = 0; first < number_left;) {
+            auto entry = page_entry(pointers[first]);
+            auto last = first + 1;
+            while (last < number_left) {
+                auto next = page_entry(pointers[last]);
+                if (next.arena != entry.arena || next.kind != entry.kind) {
+                    break;
+                }
+                ++last;
+            }
+
+            auto& arena = arena_from_index(entry.arena);
+            if (&arena != &own) {
+                for (auto i = first; i < last; ++i) {
+                    add_to_chain(chain, arena, pointers[i]);
+                }
+            } else {
+                if (!lock) {
+                    lock.lock();
+                }
+                if (entry.kind == PageKind::SLAB) {
+                    for (auto i = first; i < last; ++i) {
+                        arena.deallocate_small(pointers[i]);
+                    }
+                } else {
+                    arena.deallocate_batch(pointers + first, last - first);
+                }
+            }
+            first = last;
+        }
+        if (lock) {
+            lock.unlock();
+        }
+        push_chain(chain);
+        start_background_purge();
     }
 
-    Header_t* coalesce(Header_t* header_one, Header_t* header_two) {
-        // assert a bunch of things
-        assert(header_one);
-        assert(header_two);
-        assert(boundary_aligned(header_one));
-        assert(boundary_aligned(header_two));
-        assert(header_one != header_two);
-        assert(boundary_aligned(header_one->datum));
-        assert(boundary_aligned(header_two->datum));
+    bool thread_cache_active() {
+        if (thread_cache.state == CacheState::ACTIVE) {
+            return true;
+        }
 
-        // assign the lesser of the two to be the min_header, since we need to
-        // coalesce the blocks, and we don't care about the order in which the
-        // blocks are given
-        auto min_header = std::min(header_one, header_two);
-        auto max_header = std::max(header_one, header_two);
+        // odr-use the guard so that it gets constructed in this thread, its
+        // destructor then runs when the thread exits.  Registering the
+        // destructor can allocate memory, so the cache is activated first
+        // and the allocation is served from the cache rather than coming
+        // back here
+        if (thread_cache.state == CacheState::UNINITIALIZED) {
+            thread_cache.state = CacheState::ACTIVE;
+            thread_cache.cpu_caches = cpu_caches_enabled();
+            thread_cache.bytes_until_sample = sample_stride();
+            auto& guard = thread_cache_guard;
+            static_cast<void>(guard);
 
-        // if the max one is immediately after the lesser one, then coalesce
-        // them and return the pointer to the coalesced block
-        if (reinterpret_cast<uintptr_t>(min_header + 1) + min_header->datum
-                == reinterpret_cast<uintptr_t>(max_header)) {
-            min_header->datum += sizeof(Header_t);
-            min_header->datum += max_header->datum;
-            return min_header;
+            auto& arena = thread_arena();
+            std::lock_guard<Arena> lock{arena};
+            arena.attach(&thread_cache.statistics);
+            return true;
         }
+        return false;
+    }
 
-        return nullptr;
+    Arena& thread_arena() {
+        if (!thread_cache.arena) {
+            thread_cache.arena = &assign_arena();
+        }
+        return *thread_cache.arena;
     }
 
-    FreeList_t::NodeIterator insert_sorted(Header_t* to_insert) {
-        assert(to_insert);
-        auto iter = std::find_if_not(free_list.begin(), free_list.end(),
-                [&](auto header) {
-            return header < to_insert;
-        });
-        return free_list.insert(iter, to_insert);
+    void* allocate_from_arena(Arena& arena, int amount) {
+        if (amount <= SLAB_LIMIT) {
+            return arena.allocate_small(amount);
+        }
+        return static_cast<void*>(arena.allocate(amount) + 1);
     }
 
-    void print_free_list() {
-        using std::cout;
-        using std::endl;
-        for (const auto& node : free_list) {
-            cout << reinterpret_cast<uintptr_t>(node) << " " << node->datum
-                 << endl;
+    void deallocate_to_arena(Arena& arena, void* address, PageKind kind) {
+        assert(kind == PageKind::SLAB || kind == PageKind::CHUNK);
+        if (kind == PageKind::SLAB) {
+            arena.deallocate_small(address);
+        } else {
+            arena.deallocate(static_cast<Header_t*>(address) - 1);
         }
-        cout << endl;
     }
 
-} // namespace <anonymous>
+    void refill_cache(int index) {
+        assert(!thread_cache.heads[index]);
+        auto amount = (index + 1) * static_cast<int>(alignof(max_align_t));
 
-} // namespace eecs281
+        // each block is counted as it is linked in, so the count stays right
+        // if the arena runs out of memory partway through the batch
+        auto& arena = thread_arena();
+        std::lock_guard<Arena> lock{arena};
+        for (auto i = 0; i < CACHE_BATCH; ++i) {
+            auto block = static_cast<CachedBlock*>(
+                    allocate_from_arena(arena, amount));
+            block->next = thread_cache.heads[index];
+            thread_cache.heads[index] = block;
+            ++thread_cache.counts[index];
+        }
+    }
 
+    void cache_block(void* address, int index) {
+        // a CPU cache bin that is full is flushed once, if the thread has
+        // moved to another CPU with a full bin in the meantime the block
+        // goes straight back to its arena
+        if (thread_cache.cpu_caches) {
+            if (!cpu_cache_push(index, address)) {
+                flush_cpu_cache(index);
+                if (!cpu_cache_push(index, address)) {
+                    release_blocks(&address, 1);
+                }
+            }
+            return;
+        }
 
-int main() {
-    using namespace std;
-    using namespace eecs281;
+        auto block = static_cast<CachedBlock*>(address);
+        block->next = thread_cache.heads[index];
+        thread_cache.heads[index] = block;
+        if (++thread_cache.counts[index] > CACHE_CAPACITY) {
+            flush_cache(index, CACHE_BATCH);
+        }
+    }
 
-    auto pointer_one = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_one) << endl;
-    print_free_list();
+    void flush_cache(int index, int count) {
+        void* blocks[CACHE_BATCH];
+        while (count > 0 && thread_cache.heads[index]) {
+            auto number = 0;
+            for (; number < std::min(count, CACHE_BATCH)
+                    && thread_cache.heads[index]; ++number) {
+                auto block = thread_cache.heads[index];
+                thread_cache.heads[index] = block->next;
+                --thread_cache.counts[index];
+                blocks[number] = static_cast<void*>(block);
+            }
+            count -= number;
+            release_blocks(blocks, number);
+        }
+    }
 
-    auto pointer_two = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_two) << endl;
-    print_free_list();
+    void* take_cached_block(int index) {
+        if (thread_cache.cpu_caches) {
+            if (auto block = cpu_cache_pop(index)) {
+                return block;
+            }
+            return refill_cpu_cache(index);
+        }
 
-    auto pointer_three = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_three) << endl;
-    print_free_list();
+        if (!thread_cache.heads[index]) {
+            refill_cache(index);
+        }
+        auto block = thread_cache.heads[index];
+        thread_cache.heads[index] = block->next;
+        --thread_cache.counts[index];
+        return static_cast<void*>(block);
+    }
 
-    auto pointer_four = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_four) << endl;
-    print_free_list();
+    void* refill_cpu_cache(int index) {
+        auto amount = (index + 1) * static_cast<int>(alignof(max_align_t));
+        void* blocks[CACHE_BATCH + 1];
+        {
+            auto& arena = thread_arena();
+            std::lock_guard<Arena> lock{arena};
+            for (auto i = 0; i < CACHE_BATCH + 1; ++i) {
+                blocks[i] = allocate_from_arena(arena, amount);
+            }
+        }
 
-    auto pointer_five = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_five) << endl;
-    print_free_list();
+        // the first block is returned and the blocks that do not fit are
+        // packed into the front of the array in its place
+        auto block = blocks[0];
+        auto number_left = 0;
+        for (auto i = 1; i < CACHE_BATCH + 1; ++i) {
+            if (!cpu_cache_push(index, blocks[i])) {
+                blocks[number_left++] = blocks[i];
+            }
+        }
+        if (number_left) {
+            release_blocks(blocks, number_left);
+        }
+        return block;
+    }
 
-    auto pointer_six = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_six) << endl;
-    print_free_list();
+    void flush_cpu_cache(int index) {
+        void* blocks[CACHE_BATCH];
+        auto number = 0;
+        for (; number < CACHE_BATCH; ++number) {
+            blocks[number] = cpu_cache_pop(index);
+            if (!blocks[number]) {
+                break;
+            }
+        }
+        release_blocks(blocks, number);
+    }
 
-    auto pointer_seven = eecs281::malloc(10);
-    cout << reinterpret_cast<uintptr_t>(pointer_seven) << endl;
-    print_free_list();
+    void release_blocks(void* const* blocks, int count) {
+        // the blocks in a cache can belong to any arena, since a thread can
+        // free memory that another thread allocated.  Only the thread's own
+        // arena is locked, blocks of the other arenas are chained up and
+        // pushed onto their remote free stacks, so a thread that frees what
+        // other threads allocate does not contend on their locks
+        auto& own = thread_arena();
+        auto lock = std::unique_lock<Arena>{own, std::defer_lock};
+        auto chain = RemoteChain{nullptr, nullptr, nullptr};
+        for (auto i = 0; i < count; ++i) {
+            auto entry = page_entry(blocks[i]);
+            auto& arena = arena_from_index(entry.arena);
+            if (&arena != &own) {
+                add_to_chain(chain, arena, blocks[i]);
+                continue;
+            }
+            if (!lock) {
+                lock.lock();
+            }
+            deallocate_to_arena(arena, blocks[i], entry.kind);
+        }
+        if (lock) {
+            lock.unlock();
+        }
+        push_chain(chain);
+        start_background_purge();
+    }
 
-    cout << "Freeing pointer 7" << endl;
-    eecs281::free(pointer_seven);
-    print_free_list();
+    void add_to_chain(RemoteChain& chain, Arena& arena, void* address) {
+        if (chain.arena != &arena) {
+            push_chain(chain);
+            chain.arena = &arena;
+        }
+        auto node = static_cast<RemoteFree*>(address);
+        if (chain.last) {
+            chain.last->next = node;
+        } else {
+            chain.first = node;
+        }
+        chain.last = node;
+    }
 
-    cout << "Freeing pointer 5" << endl;
-    eecs281::free(pointer_five);
-    print_free_list();
+    void push_chain(RemoteChain& chain) {
+        if (chain.first) {
+            chain.arena->free_remote(chain.first, chain.last);
+        }
+        chain = RemoteChain{nullptr, nullptr, nullptr};
+    }
 
-    cout << "Freeing pointer 6" << endl;
-    eecs281::free(pointer_six);
-    print_free_list();
+    void* allocate_sampled(int amount) {
+        // the countdown is zero until the thread's cache is set up, which
+        // starts it, so a first allocation that does not use the cache is
+        // counted against the countdown here
+        if (thread_cache.state == CacheState::UNINITIALIZED) {
+            thread_cache_active();
+            thread_cache.bytes_until_sample -= amount;
+            if (thread_cache.bytes_until_sample >= 0) {
+                return nullptr;
+            }
+        }
+        thread_cache.bytes_until_sample = sample_stride();
+        auto sample = record_sample(amount);
+        if (!sample) {
+            return nullptr;
+        }
 
-    cout << "Freeing pointer 4" << endl;
-    eecs281::free(pointer_four);
-    print_free_list();
+        auto header_ptr = static_cast<Header_t*>(nullptr);
+        try {
+            if (amount >= config().mmap_threshold) {
+                header_ptr = make_mapped_block(extend_heap(
+                            amount + static_cast<int>(sizeof(Header_t))));
+                add_mapped_block(header_ptr);
+                header_ptr->datum.flags |= SAMPLED;
+                header_ptr->datum.sample = sample;
+            } else {
+                auto& arena = thread_arena();
+                std::lock_guard<Arena> lock{arena};
+                header_ptr = arena.allocate(amount);
+                header_ptr->datum.flags |= SAMPLED;
+                header_ptr->datum.sample = sample;
+            }
+        } catch (const std::bad_alloc&) {
+            drop_sample(sample);
+            throw;
+        }
+        count_malloc(header_ptr->datum.size);
+        return static_cast<void*>(header_ptr + 1);
+    }
 
-    cout << "Freeing pointer 2" << endl;
-    eecs281::free(pointer_two);
-    print_free_list();
+    void count_malloc(int size) {
+        if (thread_cache_active()) {
+            increment(thread_cache.statistics.mallocs[bin_index(size)]);
+            return;
+        }
+        auto& arena = thread_arena();
+        std::lock_guard<Arena> lock{arena};
+        arena.count_malloc(size);
+    }
 
-    cout << "Freeing pointer 3" << endl;
-    eecs281::free(pointer_three);
-    print_free_list();
+    void count_free(int size) {
+        if (thread_cache_active()) {
+            increment(thread_cache.statistics.frees[bin_index(size)]);
+            return;
+        }
+        auto& arena = thread_arena();
+        std::lock_guard<Arena> lock{arena};
+        arena.count_free(size);
+    }
 
-    cout << "Freeing pointer 1" << endl;
-    eecs281::free(pointer_one);
-    print_free_list();
-    return 0;
-}
+    void increment(std::atomic<std::uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+    }
+
+    void add_mapped_block(Header_t* header_ptr) {
+        map_pages(header_ptr + 1, 1,
+                PageEntry{PageKind::MAPPED, -1, header_ptr});
+        mapped_block_bytes.fetch_add(mapped_region(header_ptr).second,
+                std::memory_order_relaxed);
+        mapped_block_usable_bytes.fetch_add(header_ptr->datum.size,
+                std::memory_order_relaxed);
+    }
+
+    void remove_mapped_block(Header_t* header_ptr) {
+        unmap_pages(header_ptr + 1, 1);
+        mapped_block_bytes.fetch_sub(mapped_region(header_ptr).second,
+                std::memory_order_relaxed);
+        mapped_block_usable_bytes.fetch_sub(header_ptr->datum.size,
+                std::memory_order_relaxed);
+    }
+
+    void* move_memory(void* address, int old_size, int amount) {
+        auto new_address = allocate_memory(amount);
+        std::memcpy(new_address, address, std::min(old_size, amount));
+        free_memory(address);
+        return new_address;
+    }
+
+    void* resize_mapped(Header_t* header_ptr, int amount) {
+        // the header keeps its offset into the mapping, it is not at the
+        // start of the mapping when the memory had to be aligned
+        auto region = mapped_region(header_ptr);
+        auto offset = static_cast<int>(reinterpret_cast<uintptr_t>(header_ptr)
+                - reinterpret_cast<uintptr_t>(region.first));
+        remove_mapped_block(header_ptr);
+        auto resized = std::pair<void*, int>{};
+        try {
+            resized = resize_heap(region.first, region.second,
+                    offset + static_cast<int>(sizeof(Header_t)) + amount);
+        } catch (const std::bad_alloc&) {
+            add_mapped_block(header_ptr);
+            throw;
+        }
+
+        auto new_header = reinterpret_cast<Header_t*>(
+                static_cast<char*>(resized.first) + offset);
+        new_header->datum.size = resized.second - offset
+            - static_cast<int>(sizeof(Header_t));
+        add_mapped_block(new_header);
+        return static_cast<void*>(new_header + 1);
+    }
+
+    ThreadCacheGuard::~ThreadCacheGuard() {
+        for (auto index = 0; index < NUMBER_CACHE_BINS; ++index) {
+            flush_cache(index, thread_cache.counts[index]);
+        }
+
+        // the counters are about to go away with the thread, so they are
+        // added to its arena
+        {
+            auto& arena = thread_arena();
+            std::lock_guard<Arena> lock{arena};
+            arena.detach(&thread_cache.statistics);
+        }
+        thread_cache.state = CacheState::DISABLED;
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
@@ -11,23 +11,91 @@
  * features like iterators and generic algorithms are used here to make this
  * process simpler
  *
- * The implemetation follows a simple first fit algorithm, the runtime looks
- * through the available memory on the heap to find the first fragmented data
- * block that is large enough to fit the user's request.  Subsequently after
- * the memory is returned to the user the implementation inserts the unused
- * portion of that memory in order of increasing address values, so that
- * freed coalescing blocks into one block can be easier and faster (O(log(n))
- * time).  In contrast a best fit algorithm would have faster allocations but
- * slower deletions and frees.  Unless a garbage collection strategy is
- * employed to periodically coalesce blocks where possible
+ * The small free blocks on the heap are kept in segregated bins, there is
+ * one bin for every small block size.  A bitmap records which bins are non
+ * empty, so that the runtime can find a block that is large enough to fit
+ * the user's request with a single find-first-set instead of looking
+ * through all the fragmented blocks on the heap.  The larger free blocks are
+ * kept in a red-black tree ordered by size and address whose links live
+ * inside the free blocks themselves (see IntrusiveTree.hpp).  Every request
+ * is served best fit, in O(1) time from the bins and in O(log n) time from
+ * the tree.  Subsequently after the memory is returned to the user the
+ * implementation inserts the unused portion of that memory back into the
+ * bin or the tree that corresponds to its size
+ *
+ * Small requests (of up to 256 bytes) do not use blocks at all.  They are
+ * served from page sized slabs that each hold objects of a single size, a
+ * bitmap in the slab records which objects are free, and the objects are
+ * packed densely with no header in front of them.
+ *
+ * Every page that memory is handed out from is recorded in a radix tree
+ * keyed by page number (see pagemap.hpp), which maps a pointer to its slab,
+ * to the arena that it belongs to or to the header of a block with a
+ * mapping of its own without reading the memory around the pointer
+ *
+ * Every block carries a boundary tag, the header records the size of the
+ * block and whether it and the block physically before it are in use, and a
+ * free block also records its size in its last bytes.  So when memory is
+ * freed both of its physical neighbours can be found and coalesced with it
+ * in constant time
+ *
+ * The whole pages inside free blocks are purged back to the operating
+ * system with madvise(2) as they age, the number of dirty pages that the
+ * heap keeps decays to zero over a decay time that is read from the
+ * EECS281_MALLOC_DECAY_MS environment variable (10 seconds by default).  The
+ * decay advances when memory is freed, or once per epoch on a background
+ * thread when EECS281_MALLOC_BACKGROUND_PURGE is set to 1
+ *
+ * Setting EECS281_MALLOC_HUGE_PAGES to 1 grows the heap in 2 MiB aligned
+ * chunks that the kernel is asked to back with transparent huge pages (2
+ * maps them from the reserved pool of huge pages with MAP_HUGETLB instead),
+ * which reduces TLB misses for programs that chase pointers across a large
+ * heap.  Small objects are packed into one huge page before the next one is
+ * touched
+ *
+ * Large requests (of at least 128 KiB by default, the threshold is read from
+ * the EECS281_MALLOC_MMAP_THRESHOLD environment variable) bypass the heap
+ * entirely.  Each of them gets a mapping from the operating system all to
+ * itself with the block's header at its start, and the mapping is unmapped
+ * as soon as the block is freed, so large buffers neither fragment the heap
+ * nor keep memory resident after they are freed
+ *
+ * malloc() and free() are thread safe.  Each thread keeps a small cache of
+ * the small blocks that it has recently freed, and most calls are served
+ * from that cache without any locks or atomics.  The cache is refilled from
+ * and flushed to the heap in batches.  With EECS281_MALLOC_CPU_CACHES set to
+ * 1 the caches belong to the CPUs rather than the threads where the kernel
+ * supports it, see cpu_cache.hpp.  The heap itself is split into a
+ * number of arenas, each with its own lock and its own memory from the
+ * operating system, and threads are assigned to the arenas round robin so
+ * that they rarely contend on the same lock.  The number of arenas is read
+ * from the EECS281_MALLOC_ARENAS environment variable and defaults to four
+ * times the number of cores
+ *
+ * The allocator keeps counters of the memory that it has mapped, handed out
+ * and has free, and of the allocations in each size class, these can be
+ * read at any time with statistics() and printed as text or as JSON (see
+ * statistics.hpp)
+ *
+ * Setting EECS281_MALLOC_SAMPLE_BYTES turns on a sampling heap profiler that
+ * records the stack traces of about one allocation in every so many bytes,
+ * the live samples can be dumped for pprof with print_heap_profile() (see
+ * profiler.hpp)
+ *
+ * Setting EECS281_MALLOC_TRACE to a path logs every call into the allocator
+ * to a ring of binary records in that file, which trace_replay can replay
+ * against this allocator or another one (see trace.hpp)
+ *
+ * The allocator can also be built as libsharpmalloc.so (see the Makefile and
+ * sharpmalloc.cpp), which exports it under the names of the C library's
+ * allocation functions and of the C++ allocation operators so that it can
+ * replace the system allocator in any program through LD_PRELOAD
  *
  * This allocator is meant to be simple, as such it does not maintain any
  * metadata more than the bare minimum that is required without sacrificing
- * code redability.  It does not guarantee things like thread safety and does
- * not try and optimize performance across cores by utilizing thread local
- * arenas.  If you are curious and want more information on the implementation
- * of Industry level allocators, then look into libraies such as jemalloc
- * located at https://github.com/jemalloc/jemalloc
+ * code redability.  If you are curious and want more information on the
+ * implementation of Industry level allocators, then look into libraies such
+ * as jemalloc located at https://github.com/jemalloc/jemalloc
  *
  * There are no security guarantees in place with this allocator either, as a
  * result it will be extremely easy for an attacker to exploit a buffer
@@ -47,21 +115,35 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <limits>
+
+#include "statistics.hpp"
 
 namespace eecs281 {
 
+/**
+ * The largest request that the C and C++ interfaces built on top of this
+ * allocator pass on to it, this leaves room below the largest int for the
+ * headers, the padding of aligned requests and the rounding to whole (huge)
+ * pages that the allocator adds on top of the request
+ */
+constexpr auto MAXIMUM_REQUEST = std::numeric_limits<int>::max() - (1 << 22);
+
 /**
  * The allocator part of the drop in replacement for malloc(3) and free(3),
- * this can be wrapped around in an allocator class to make it compatible with
- * no weight for STL components.
+ * STL containers can use it through the allocator class in Allocator.hpp or
+ * through the polymorphic memory resource in memory_resource.hpp
  *
  * The pointer returned by malloc is aligned on the widest byte boundary that
  * is required by any fundamental type and any custom type that is built from
- * fundamental types.  Extended alignment (for example with alignas) is not
- * supported by this allocator alone.  The maximum alignment requirement (or
+ * fundamental types.  Extended alignment (for example with alignas) needs
+ * aligned_alloc() below.  The maximum alignment requirement (or
  * the minumum alignment requirement that will not cause a fault) is
  * determined by the alignment of std::max_align_t
  *
+ * Like malloc(3) a request for 0 bytes returns memory that can be freed, a
+ * negative amount throws a std::bad_alloc exception
+ *
  * @param amount_of_memory the amount of memory in bytes that have to be
  *        allocated, for example, if you want to allocate 4 integers each 4
  *        bytes wide, then you would call malloc with 4*4 as the
@@ -74,8 +156,148 @@ void* malloc(int amount);
 /**
  * The free function associated with the malloc function above, this works
  * only with the malloc above, using it with any other memory allocator is
- * *undefined behavior*, use with caution
+ * *undefined behavior*, use with caution.  Like free(3) freeing a nullptr
+ * does nothing.  A pointer that is not on a page that the allocator hands
+ * out memory from fails an assertion, and is left alone when assertions
+ * are turned off
  */
 void free(void* pointer_to_free);
 
+/**
+ * Frees memory whose size the caller knows, like free_sized() in C23 and the
+ * sized operator delete in C++14.  Memory small enough for a slab goes
+ * straight into the thread's cache for its size without looking the memory
+ * up in the page map, which saves a likely cache miss when the
+ * memory has not been touched in a while
+ *
+ * @param pointer_to_free memory that came from the malloc above, or a
+ *        nullptr
+ * @param size the size that was passed to malloc (or realloc) for the
+ *        memory, or any size between that and malloc_usable_size()
+ */
+void free_sized(void* pointer_to_free, int size);
+
+/**
+ * Returns the number of bytes that can be used in the memory, this is at
+ * least the amount that was requested and can be more since requests are
+ * rounded up to a size class or to a whole block.  All of these bytes can
+ * be used by the caller, so a container can grow into them without calling
+ * realloc
+ *
+ * @param pointer memory that came from the malloc above
+ */
+int malloc_usable_size(void* pointer);
+
+/**
+ * Allocates memory for an array of number elements of size bytes each and
+ * sets all of it to zero, like calloc(3).  Memory that comes straight from
+ * the operating system is already zero filled, so it is only cleared when
+ * it has been used before.  This way a large zeroed array is touched once by
+ * the program rather than once by calloc and again by the program
+ *
+ * On overflow of number * size this throws a std::bad_alloc exception, like
+ * malloc does when there is no memory
+ *
+ * @param number the number of elements
+ * @param size the size of each element in bytes
+ */
+void* calloc(int number, int size);
+
+/**
+ * The realloc function associated with the malloc function above, this
+ * resizes the memory to amount bytes and returns a pointer to it, the
+ * contents of the memory up to the lesser of the old and the new size are
+ * preserved.  Memory is resized in place whenever possible, a block shrinks
+ * by giving its tail back to the heap and grows by taking over the free
+ * block right after it.  Memory with a mapping of its own is resized with
+ * mremap(2) so that it is never copied.  Otherwise the memory is moved to a
+ * new allocation
+ *
+ * Like realloc(3) a nullptr is treated as a call to malloc and an amount of
+ * 0 frees the memory and returns a nullptr
+ *
+ * @param pointer the memory to resize, this should have come from the malloc
+ *        above or be a nullptr
+ * @param amount the new size of the memory in bytes
+ *
+ * @return a pointer to the resized memory, this is not necessarily the same
+ *         as the pointer that was passed in
+ */
+void* realloc(void* pointer, int amount);
+
+/**
+ * Allocates memory that is aligned to the given alignment, which can be
+ * larger than the alignment of std::max_align_t.  The memory can be freed
+ * with the free function above.  A block is carved out of a larger block on
+ * the heap, and the padding before the aligned address is given back to the
+ * heap as a free block of its own rather than being wasted
+ *
+ * @param alignment the alignment of the memory, this should be a power of
+ *        two
+ * @param amount the amount of memory in bytes
+ *
+ * @return the aligned memory, or a nullptr if the alignment is not a power
+ *         of two
+ */
+void* aligned_alloc(int alignment, int amount);
+
+/**
+ * The POSIX version of aligned_alloc(), the memory is stored in *pointer
+ *
+ * @return 0 on success, EINVAL if the alignment is not a power of two
+ *         multiple of sizeof(void*) and ENOMEM if there is no memory
+ */
+int posix_memalign(void** pointer, int alignment, int amount);
+
+/**
+ * Allocates count pieces of memory of amount bytes each and frees count
+ * pieces of memory respectively, for programs that allocate and free many
+ * objects of the same size at once.  The arena is locked once per batch
+ * rather than once per object, and blocks are carved out of one larger
+ * block a group at a time.  A batch that is freed is sorted by address
+ * first, so the memory of each arena is freed under a single lock and blocks
+ * that are next to each other in memory are coalesced with each other
+ * before they go back into the bins.  Small memory is taken from the
+ * thread's cache before the arena is locked
+ *
+ * The memory from malloc_batch() can be freed one piece at a time with the
+ * free function above and memory from the malloc above can be freed with
+ * free_batch().  If there is not enough memory for the whole batch then
+ * malloc_batch() throws a std::bad_alloc exception and allocates nothing
+ *
+ * @param amount the size of each piece of memory in bytes
+ * @param count the number of pieces of memory
+ * @param pointers the array that the memory is written to, or the memory to
+ *        free, which can contain nullptrs.  free_batch() reorders the array
+ *        and leaves its contents unspecified
+ */
+void malloc_batch(int amount, int count, void** pointers);
+void free_batch(void** pointers, int count);
+
+/**
+ * Counters for the purging of dirty pages, the number of pages that have
+ * been purged back to the operating system and the number of those pages
+ * that were handed out again afterwards (each of which costs a page fault).
+ * A high reuse count relative to the purge count means that the decay time
+ * is too short for the program
+ */
+struct PurgeStatistics {
+    std::uint64_t pages_purged;
+    std::uint64_t pages_reused;
+};
+
+/**
+ * Returns the purge counters summed over every arena
+ */
+PurgeStatistics purge_statistics();
+
+/**
+ * Returns a snapshot of the statistics of the allocator, see
+ * statistics.hpp.  This locks every arena in turn, so the snapshot is not
+ * taken at a single instant, and it reads the counters of running threads
+ * without stopping them.  It is cheap enough to call every few seconds but
+ * not on every allocation
+ */
+Statistics statistics();
+
 } // namespace eecs281
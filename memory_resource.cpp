@@ -0,0 +1,58 @@
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+
+#include "eecs281malloc.hpp"
+#include "memory_resource.hpp"
+#include "profiler.hpp"
+
+using std::max_align_t;
+
+namespace eecs281 {
+
+EECS281_ALLOCATOR_TEXT
+void* memory_resource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    if (bytes > static_cast<std::size_t>(MAXIMUM_REQUEST)
+            || alignment > static_cast<std::size_t>(MAXIMUM_REQUEST)) {
+        throw std::bad_alloc{};
+    }
+
+    // aligned_alloc() returns a nullptr when the alignment is not a power of
+    // two, the resource has to throw instead
+    auto amount = static_cast<int>(bytes);
+    if (alignment <= alignof(max_align_t)) {
+        return eecs281::malloc(amount);
+    }
+    auto pointer = eecs281::aligned_alloc(static_cast<int>(alignment),
+            amount);
+    if (!pointer) {
+        throw std::bad_alloc{};
+    }
+    return pointer;
+}
+
+void memory_resource::do_deallocate(void* pointer, std::size_t bytes,
+                                    std::size_t alignment) {
+    if (alignment <= alignof(max_align_t)) {
+        eecs281::free_sized(pointer, static_cast<int>(bytes));
+        return;
+    }
+    eecs281::free(pointer);
+}
+
+bool memory_resource::do_is_equal(const std::pmr::memory_resource& other)
+        const noexcept {
+    return dynamic_cast<const memory_resource*>(&other) != nullptr;
+}
+
+std::pmr::memory_resource* malloc_resource() noexcept {
+    // the resource is never destroyed, so that containers with static
+    // storage duration can still free their memory through it while the
+    // program exits
+    alignas(memory_resource) static unsigned char storage[
+        sizeof(memory_resource)];
+    static auto resource = new (storage) memory_resource{};
+    return resource;
+}
+
+} // namespace eecs281
@@ -0,0 +1,49 @@
+/**
+ * @file memory_resource.hpp
+ * @author Aaryaman Sagar
+ *
+ * A polymorphic memory resource that gets its memory from the allocator in
+ * eecs281malloc.hpp, so the std::pmr containers can use the allocator
+ * without replacing malloc for the whole program
+ *
+ *  auto vector = std::pmr::vector<int>{eecs281::malloc_resource()};
+ *
+ * The resource has no state, memory allocated through any instance can be
+ * freed through any other one.  Memory that is aligned to at most the
+ * alignment of std::max_align_t comes from malloc() and is freed with
+ * free_sized(), memory with a larger alignment comes from aligned_alloc()
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace eecs281 {
+
+class memory_resource : public std::pmr::memory_resource {
+private:
+
+    /**
+     * Allocates bytes bytes aligned to alignment and frees them
+     * respectively, allocating throws a std::bad_alloc exception when the
+     * request is too large or there is no memory
+     */
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* pointer, std::size_t bytes,
+                       std::size_t alignment) override;
+
+    /**
+     * Every instance of this class can free the memory of every other one
+     */
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept
+        override;
+};
+
+/**
+ * Returns a resource that lives for as long as the program does, like
+ * std::pmr::new_delete_resource()
+ */
+std::pmr::memory_resource* malloc_resource() noexcept;
+
+} // namespace eecs281
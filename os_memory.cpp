@@ -1,7 +1,10 @@
 #include <utility>
 #include <cassert>
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <new>
 #include <type_traits>
 #include <unistd.h>
 #include <sys/mman.h>
@@ -24,8 +27,58 @@ namespace {
      * typical system call requires a lot of overhead.  Although this library
      * does not assert that the overhead is much larger than the overhead in
      * the actual malloc(3) call itself ¯\_(ツ)_/¯
+     *
+     * This is a function rather than a constant so that it works for calls
+     * to malloc() that happen before the static initializers of the library
+     * have run, for example from the constructors of other libraries
      */
-    const auto MINIMUM_BATCH = getpagesize();
+    int minimum_batch();
+
+    /**
+     * The size of the range of addresses that is reserved for the heap, the
+     * size of the part at its end that memory aligned to more than a page is
+     * carved out of, and the bounds on the steps in which each part is made
+     * usable.  Reserving the range costs nothing but address space, the
+     * first step is small so that small programs do not map much and the
+     * steps stop growing at some point so that the heap is not made usable
+     * far past what it needs
+     */
+    constexpr auto HEAP_RESERVATION_SIZE = std::uintptr_t{1} << 36;
+    constexpr auto ALIGNED_RESERVATION_SIZE = std::uintptr_t{1} << 34;
+    constexpr auto MINIMUM_COMMIT_STEP = std::uintptr_t{1} << 20;
+    constexpr auto MAXIMUM_COMMIT_STEP = std::uintptr_t{1} << 28;
+
+    /**
+     * A part of the reserved range, the cursor is the end of what has been
+     * handed out and the committed end is the end of what has been made
+     * usable.  The bounds are set once when the range is reserved
+     */
+    struct ReservedPart {
+        std::uintptr_t start;
+        std::uintptr_t end;
+        std::atomic<std::uintptr_t> cursor;
+        std::atomic<std::uintptr_t> committed;
+    };
+
+    /**
+     * The part that chunks are carved out of and the part that aligned
+     * memory is carved out of, so that the gap in front of aligned memory
+     * never comes between two chunks that are otherwise next to each other
+     */
+    ReservedPart chunk_reservation{};
+    ReservedPart aligned_reservation{};
+
+    /**
+     * Reserves the range and splits it into its parts on the first call,
+     * returns false if it could not be reserved
+     */
+    bool reserve_heap();
+
+    /**
+     * Makes the part of the reserved range usable up to at least the given
+     * address, returns false if the operating system refuses
+     */
+    bool commit_reservation(ReservedPart& part, std::uintptr_t end);
 
     /**
      * An implementation of a roundup function using bitwise operations, the
@@ -51,8 +104,8 @@ std::pair<void*, int> extend_heap(int amount_of_memory) {
     // operating system from the mmap call, this has to be a multiple of the
     // page boundary since we want to be good memory citizens (consult the
     // local manual pages for mmap(2) for more details)
-    auto actual_amount = std::max(amount_of_memory, MINIMUM_BATCH);
-    actual_amount = round_up_to(actual_amount, MINIMUM_BATCH);
+    auto actual_amount = std::max(amount_of_memory, minimum_batch());
+    actual_amount = round_up_to(actual_amount, minimum_batch());
 
     // then request the memory from the operating system, error check and
     // throw an exception with a string error message as fetched from the
@@ -81,6 +134,138 @@ std::pair<void*, int> extend_heap(int amount_of_memory) {
     return std::make_pair(memory, actual_amount);
 }
 
+std::pair<void*, int> extend_heap_aligned(int amount_of_memory,
+                                          int alignment) {
+    assert(amount_of_memory > 0);
+    assert(!(amount_of_memory % minimum_batch()));
+    assert(!(alignment % minimum_batch()));
+    assert(!(alignment & (alignment - 1)));
+
+    // map enough memory that an aligned range of the right length is always
+    // somewhere inside it, and then give back the parts before and after
+    // that range
+    auto length = static_cast<std::size_t>(amount_of_memory) + alignment;
+    auto memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+            MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+
+    auto start = reinterpret_cast<uintptr_t>(memory);
+    auto aligned = (start + alignment - 1)
+        & ~static_cast<uintptr_t>(alignment - 1);
+    auto end = start + length;
+    if (aligned != start) {
+        munmap(memory, aligned - start);
+    }
+    if (aligned + amount_of_memory != end) {
+        munmap(reinterpret_cast<void*>(aligned + amount_of_memory),
+                end - (aligned + amount_of_memory));
+    }
+    return std::make_pair(reinterpret_cast<void*>(aligned), amount_of_memory);
+}
+
+std::pair<void*, int> extend_heap_huge(int amount_of_memory,
+                                       bool explicit_huge_pages) {
+    assert(amount_of_memory > 0);
+    auto actual_amount = round_up_to(amount_of_memory, HUGE_PAGE_SIZE);
+
+    // mappings with MAP_HUGETLB are always aligned to the huge page size,
+    // they fail when there are not enough huge pages reserved in which case
+    // this falls back to transparent huge pages
+    if (explicit_huge_pages) {
+        auto memory = mmap(nullptr, actual_amount, PROT_READ | PROT_WRITE,
+                MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            return std::make_pair(memory, actual_amount);
+        }
+    }
+
+    // the kernel can only back the memory with huge pages if it is aligned
+    // to the huge page size, the advice fails harmlessly when transparent
+    // huge pages are disabled on the system
+    auto memory = extend_heap_aligned(actual_amount, HUGE_PAGE_SIZE);
+    madvise(memory.first, memory.second, MADV_HUGEPAGE);
+    return memory;
+}
+
+std::pair<void*, int> extend_heap_reserved(int amount_of_memory,
+                                           int alignment) {
+    assert(amount_of_memory > 0);
+    assert(!(alignment % minimum_batch()));
+    assert(!(alignment & (alignment - 1)));
+    auto actual_amount = round_up_to(amount_of_memory, minimum_batch());
+
+    // the chunk is carved off the front of what is left of its part of the
+    // range, chunks that different threads fetch at the same time get
+    // different parts of it.  Aligned memory has a part of its own, where
+    // it is all of the same alignment in practice (slab segments) so there
+    // is no gap between one piece and the next
+    auto& part = (alignment > minimum_batch())
+        ? aligned_reservation : chunk_reservation;
+    if (reserve_heap()) {
+        auto alignment_mask = static_cast<std::uintptr_t>(alignment - 1);
+        auto cursor = part.cursor.load(std::memory_order_relaxed);
+        auto memory = std::uintptr_t{0};
+        do {
+            memory = (cursor + alignment_mask) & ~alignment_mask;
+            if (memory + actual_amount > part.end) {
+                memory = 0;
+                break;
+            }
+        } while (!part.cursor.compare_exchange_weak(cursor,
+                    memory + actual_amount, std::memory_order_relaxed));
+        if (memory) {
+            if (!commit_reservation(part, memory + actual_amount)) {
+                throw std::bad_alloc{};
+            }
+            return std::make_pair(reinterpret_cast<void*>(memory),
+                    actual_amount);
+        }
+    }
+
+    if (alignment > minimum_batch()) {
+        return extend_heap_aligned(actual_amount, alignment);
+    }
+    return extend_heap(actual_amount);
+}
+
+std::pair<void*, int> resize_heap(void* memory, int old_amount,
+                                  int new_amount) {
+    assert(!(reinterpret_cast<uintptr_t>(memory) % minimum_batch()));
+    assert(old_amount > 0);
+    assert(new_amount > 0);
+
+    auto actual_amount = round_up_to(new_amount, minimum_batch());
+    auto resized = mremap(memory, old_amount, actual_amount, MREMAP_MAYMOVE);
+    if (resized == MAP_FAILED) {
+        throw std::bad_alloc{};
+    }
+    return std::make_pair(resized, actual_amount);
+}
+
+void release_heap(void* memory, int amount_of_memory) {
+    assert(!(reinterpret_cast<uintptr_t>(memory) % minimum_batch()));
+    assert(amount_of_memory > 0);
+
+    // munmap(2) only fails when it is passed a range that is not valid,
+    // which would be a bug in the caller
+    auto result = munmap(memory, amount_of_memory);
+    assert(!result);
+    static_cast<void>(result);
+}
+
+bool purge_memory(void* memory, int amount_of_memory) {
+    assert(!(reinterpret_cast<uintptr_t>(memory) % minimum_batch()));
+    assert(amount_of_memory > 0);
+    assert(!(amount_of_memory % minimum_batch()));
+
+    // MADV_DONTNEED is used over MADV_FREE so that the resident set drops
+    // right away rather than when the kernel comes under memory pressure,
+    // which is what the purging is meant to be measured by
+    return !madvise(memory, amount_of_memory, MADV_DONTNEED);
+}
+
 namespace {
 
     int round_up_to(int value, UnsignedAlignInteger multiple) {
@@ -95,6 +280,62 @@ namespace {
         return (unsigned_value + multiple - 1) & ~(multiple - 1);
     }
 
+    bool reserve_heap() {
+        // the kernel only counts private mappings that can be written to
+        // against the memory that it has promised out, so the range costs
+        // nothing while it is PROT_NONE and each step is counted when
+        // mprotect(2) makes it writable.  MAP_NORESERVE is left out since it
+        // would keep the writable part from ever being counted
+        static const auto reserved = [] {
+            auto memory = mmap(nullptr, HEAP_RESERVATION_SIZE, PROT_NONE,
+                    MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+            if (memory == MAP_FAILED) {
+                return false;
+            }
+            auto start = reinterpret_cast<std::uintptr_t>(memory);
+            auto end = start + HEAP_RESERVATION_SIZE;
+            auto split = [](ReservedPart& part, std::uintptr_t begin,
+                            std::uintptr_t finish) {
+                part.start = begin;
+                part.end = finish;
+                part.cursor.store(begin, std::memory_order_relaxed);
+                part.committed.store(begin, std::memory_order_relaxed);
+            };
+            split(chunk_reservation, start, end - ALIGNED_RESERVATION_SIZE);
+            split(aligned_reservation, end - ALIGNED_RESERVATION_SIZE, end);
+            return true;
+        }();
+        return reserved;
+    }
+
+    bool commit_reservation(ReservedPart& part, std::uintptr_t end) {
+        // each step is as large as everything that has been made usable in
+        // the part so far, threads that race here can make the same pages
+        // usable twice which is harmless.  The committed end only ever moves
+        // forward
+        auto committed = part.committed.load(std::memory_order_acquire);
+        while (committed < end) {
+            auto step = std::min(std::max(committed - part.start,
+                        MINIMUM_COMMIT_STEP), MAXIMUM_COMMIT_STEP);
+            auto new_committed = std::min(std::max(end, committed + step),
+                    part.end);
+            if (mprotect(reinterpret_cast<void*>(committed),
+                        new_committed - committed, PROT_READ | PROT_WRITE)) {
+                return false;
+            }
+            if (part.committed.compare_exchange_weak(committed,
+                        new_committed, std::memory_order_release,
+                        std::memory_order_acquire)) {
+                committed = new_committed;
+            }
+        }
+        return true;
+    }
+
+    int minimum_batch() {
+        return getpagesize();
+    }
+
 } // namespace <anonymous>
 
 } // namespace eecs281
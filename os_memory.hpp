@@ -16,6 +16,12 @@
 
 namespace eecs281 {
 
+/**
+ * The size of a huge page on the system, this is the size of a PMD level
+ * page on x86-64 and on most configurations of aarch64
+ */
+constexpr auto HUGE_PAGE_SIZE = 1 << 21;
+
 /**
  * Allocates a chunk of memory from the operating system.  The returned
  * memory contains either as much usable memory that was requested or more
@@ -41,6 +47,125 @@ namespace eecs281 {
  */
 std::pair<void*, int> extend_heap(int amount_of_memory);
 
+/**
+ * Allocates a chunk of memory from the operating system whose address is a
+ * multiple of the given alignment.  Unlike extend_heap() the length of the
+ * returned memory is exactly the amount requested
+ *
+ * On error from the OS this function throws a std::bad_alloc exception to
+ * alert the user
+ *
+ * @param amount_of_memory the amount of memory that is to be requested from
+ *        the operating system in bytes, this should be a multiple of the page
+ *        size
+ * @param alignment the alignment of the memory, this should be a power of
+ *        two multiple of the page size
+ *
+ * @return returns a pair, the first element of the pair is the memory that
+ *         has been fetched from the operating system and the second is the
+ *         length of the memory block
+ */
+std::pair<void*, int> extend_heap_aligned(int amount_of_memory,
+                                          int alignment);
+
+/**
+ * Allocates a chunk of memory from the operating system that is backed by
+ * huge pages.  The amount is rounded up to a multiple of HUGE_PAGE_SIZE and
+ * the memory is aligned to HUGE_PAGE_SIZE.  With explicit huge pages the
+ * memory is mapped with MAP_HUGETLB from the pool of reserved huge pages,
+ * otherwise (or when that pool is exhausted) the memory is mapped normally
+ * and the kernel is asked to back it with transparent huge pages through
+ * madvise(MADV_HUGEPAGE), which is only a hint
+ *
+ * On error from the OS this function throws a std::bad_alloc exception to
+ * alert the user
+ *
+ * @param amount_of_memory the amount of memory that is to be requested from
+ *        the operating system in bytes
+ * @param explicit_huge_pages whether to map the memory with MAP_HUGETLB
+ *
+ * @return returns a pair, the first element of the pair is the memory that
+ *         has been fetched from the operating system and the second is the
+ *         length of the memory block
+ */
+std::pair<void*, int> extend_heap_huge(int amount_of_memory,
+                                       bool explicit_huge_pages);
+
+/**
+ * Allocates a chunk of memory for the arenas from one large range of
+ * addresses that is reserved up front, so that chunks fetched one after the
+ * other are next to each other in memory and an arena can merge a new chunk
+ * into the last one.  The range is reserved with PROT_NONE the first time
+ * this is called and is made readable and writable in steps that double in
+ * size, so growing the heap is a bump of a pointer most of the time and one
+ * mprotect(2) call otherwise, and the whole heap is a single mapping.
+ * Memory that is aligned to more than a page comes from a separate part of
+ * the range, so the gap in front of it never keeps two chunks apart
+ *
+ * The memory is never unmapped, it should only be purged with
+ * purge_memory().  When the range could not be reserved or is used up this
+ * falls back to extend_heap() and extend_heap_aligned()
+ *
+ * On error from the OS this function throws a std::bad_alloc exception to
+ * alert the user
+ *
+ * @param amount_of_memory the amount of memory that is to be requested in
+ *        bytes, this is rounded up to a multiple of the page size
+ * @param alignment the alignment of the memory, this should be a power of
+ *        two multiple of the page size
+ *
+ * @return returns a pair, the first element of the pair is the memory and
+ *         the second is the length of the memory block
+ */
+std::pair<void*, int> extend_heap_reserved(int amount_of_memory,
+                                           int alignment);
+
+/**
+ * Resizes memory that was fetched from the operating system with mremap(2),
+ * the memory is moved to a new address if it cannot be resized where it is.
+ * The kernel moves the pages themselves, so no bytes are copied no matter
+ * how large the memory is
+ *
+ * On error from the OS this function throws a std::bad_alloc exception to
+ * alert the user, the original memory is left alone in that case
+ *
+ * @param memory the start of the memory, this should be page aligned
+ * @param old_amount the current length of the memory in bytes
+ * @param new_amount the new length of the memory in bytes, this is rounded
+ *        up to a multiple of the page size
+ *
+ * @return returns a pair, the first element of the pair is the resized
+ *         memory and the second is its length
+ */
+std::pair<void*, int> resize_heap(void* memory, int old_amount,
+                                  int new_amount);
+
+/**
+ * Gives memory back to the operating system, the memory should be one or
+ * more whole pages that were fetched with extend_heap() or
+ * extend_heap_aligned()
+ *
+ * @param memory the start of the memory to give back
+ * @param amount_of_memory the length of the memory in bytes
+ */
+void release_heap(void* memory, int amount_of_memory);
+
+/**
+ * Tells the operating system that the contents of the memory are no longer
+ * needed, the memory stays mapped but the physical pages behind it are
+ * released with madvise(MADV_DONTNEED) so they stop counting towards the
+ * resident set of the process.  The next access to a purged page faults in
+ * a page filled with zeros
+ *
+ * @param memory the start of the memory, this should be page aligned
+ * @param amount_of_memory the length of the memory in bytes, this should be
+ *        a multiple of the page size
+ *
+ * @return true if the memory was purged, older kernels refuse to purge
+ *         memory that is mapped with MAP_HUGETLB
+ */
+bool purge_memory(void* memory, int amount_of_memory);
+
 /**
  * Rounds up the first value to the next multiple of the second value and
  * returns the result
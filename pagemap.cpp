@@ -0,0 +1,181 @@
+#include <cstdint>
+#include <cassert>
+#include <atomic>
+#include <new>
+
+#include "os_memory.hpp"
+#include "pagemap.hpp"
+
+using std::uintptr_t;
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * The page number of a user space address has 35 bits with 47 bit
+     * addresses, the top 12 bits index the root, the next 12 bits index an
+     * interior node and the last 11 bits index a leaf.  A leaf covers 8MB of
+     * the address space and an interior node covers 32GB
+     */
+    constexpr auto ADDRESS_BITS = 47;
+    constexpr auto ROOT_BITS = 12;
+    constexpr auto INTERIOR_BITS = 12;
+    constexpr auto LEAF_BITS = 11;
+    static_assert(PAGE_MAP_PAGE_BITS + ROOT_BITS + INTERIOR_BITS + LEAF_BITS
+            == ADDRESS_BITS, "The levels of the page map must cover every "
+            "user space address");
+
+    /**
+     * An entry is stored as a single word so that it can be read and
+     * written atomically.  The low two bits are the kind of the page and the
+     * rest is the header of a MAPPED page or the arena index of the others,
+     * headers are aligned to the maximum alignment so their low bits are
+     * always free
+     */
+    constexpr uintptr_t KIND_MASK = 0x3;
+    constexpr auto ARENA_SHIFT = 2;
+
+    struct Leaf {
+        std::atomic<uintptr_t> entries[1 << LEAF_BITS];
+    };
+    struct Interior {
+        std::atomic<Leaf*> leaves[1 << INTERIOR_BITS];
+    };
+
+    /**
+     * The root of the page map, the pages of the root that are never
+     * written to are never touched
+     */
+    std::atomic<Interior*> root[1 << ROOT_BITS];
+
+    /**
+     * Returns the leaf that the page number lies under, making the interior
+     * node and the leaf if they do not exist yet
+     */
+    Leaf& leaf_for(uintptr_t page);
+
+    /**
+     * Fetches a node from the operating system and installs it in the slot,
+     * if another thread got there first then the node is given back and the
+     * other thread's node is returned
+     */
+    template <typename Node>
+    Node* make_node(std::atomic<Node*>& slot);
+
+    /**
+     * Converts an entry to and from the word that is stored for a page
+     */
+    uintptr_t pack(PageEntry entry);
+    PageEntry unpack(uintptr_t word, uintptr_t page);
+
+} // namespace <anonymous>
+
+
+PageEntry page_entry(const void* pointer) {
+    auto page = reinterpret_cast<uintptr_t>(pointer) >> PAGE_MAP_PAGE_BITS;
+    if (page >> (ROOT_BITS + INTERIOR_BITS + LEAF_BITS)) {
+        return PageEntry{PageKind::NONE, -1, nullptr};
+    }
+    auto interior = root[page >> (INTERIOR_BITS + LEAF_BITS)].load(
+            std::memory_order_acquire);
+    if (!interior) {
+        return PageEntry{PageKind::NONE, -1, nullptr};
+    }
+    auto leaf = interior->leaves[(page >> LEAF_BITS)
+        & ((1 << INTERIOR_BITS) - 1)].load(std::memory_order_acquire);
+    if (!leaf) {
+        return PageEntry{PageKind::NONE, -1, nullptr};
+    }
+    return unpack(leaf->entries[page & ((1 << LEAF_BITS) - 1)].load(
+                std::memory_order_acquire), page);
+}
+
+void map_pages(const void* memory, int length, PageEntry entry) {
+    assert(length > 0);
+    auto word = pack(entry);
+    auto first = reinterpret_cast<uintptr_t>(memory) >> PAGE_MAP_PAGE_BITS;
+    auto last = (reinterpret_cast<uintptr_t>(memory) + length - 1)
+        >> PAGE_MAP_PAGE_BITS;
+
+    // the leaf is only looked up again when the pages cross into the next
+    // one
+    auto leaf = static_cast<Leaf*>(nullptr);
+    for (auto page = first; page <= last; ++page) {
+        if (!leaf || !(page & ((1 << LEAF_BITS) - 1))) {
+            leaf = &leaf_for(page);
+        }
+        leaf->entries[page & ((1 << LEAF_BITS) - 1)].store(word,
+                std::memory_order_release);
+    }
+}
+
+void unmap_pages(const void* memory, int length) {
+    map_pages(memory, length, PageEntry{PageKind::NONE, -1, nullptr});
+}
+
+namespace {
+
+    Leaf& leaf_for(uintptr_t page) {
+        assert(!(page >> (ROOT_BITS + INTERIOR_BITS + LEAF_BITS)));
+        auto& interior_slot = root[page >> (INTERIOR_BITS + LEAF_BITS)];
+        auto interior = interior_slot.load(std::memory_order_acquire);
+        if (!interior) {
+            interior = make_node(interior_slot);
+        }
+        auto& leaf_slot = interior->leaves[(page >> LEAF_BITS)
+            & ((1 << INTERIOR_BITS) - 1)];
+        auto leaf = leaf_slot.load(std::memory_order_acquire);
+        if (!leaf) {
+            leaf = make_node(leaf_slot);
+        }
+        return *leaf;
+    }
+
+    template <typename Node>
+    Node* make_node(std::atomic<Node*>& slot) {
+        auto memory = extend_heap(static_cast<int>(sizeof(Node)));
+        auto node = new (memory.first) Node{};
+        auto expected = static_cast<Node*>(nullptr);
+        if (!slot.compare_exchange_strong(expected, node,
+                    std::memory_order_acq_rel)) {
+            release_heap(memory.first, memory.second);
+            return expected;
+        }
+        return node;
+    }
+
+    uintptr_t pack(PageEntry entry) {
+        auto kind = static_cast<uintptr_t>(entry.kind);
+        if (entry.kind == PageKind::MAPPED) {
+            auto header = reinterpret_cast<uintptr_t>(entry.descriptor);
+            assert(!(header & KIND_MASK));
+            return header | kind;
+        }
+        if (entry.kind == PageKind::NONE) {
+            return kind;
+        }
+        assert(entry.arena >= 0);
+        return (static_cast<uintptr_t>(entry.arena) << ARENA_SHIFT) | kind;
+    }
+
+    PageEntry unpack(uintptr_t word, uintptr_t page) {
+        auto kind = static_cast<PageKind>(word & KIND_MASK);
+        switch (kind) {
+        case PageKind::SLAB:
+            return PageEntry{kind, static_cast<int>(word >> ARENA_SHIFT),
+                reinterpret_cast<void*>(page << PAGE_MAP_PAGE_BITS)};
+        case PageKind::CHUNK:
+            return PageEntry{kind, static_cast<int>(word >> ARENA_SHIFT),
+                nullptr};
+        case PageKind::MAPPED:
+            return PageEntry{kind, -1,
+                reinterpret_cast<void*>(word & ~KIND_MASK)};
+        default:
+            return PageEntry{PageKind::NONE, -1, nullptr};
+        }
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
@@ -0,0 +1,81 @@
+/**
+ * @file pagemap.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the page map, a radix tree keyed by the page number of
+ * an address that records what the allocator knows about every page that it
+ * hands out memory from.  A slab page maps to its slab, a page of an arena's
+ * chunk maps to the arena and the page that the memory of a block with a
+ * mapping of its own starts on maps to the header of that block
+ *
+ * Looking up a pointer takes three dependent loads and never reads the
+ * memory around the pointer, so the page map is how free() finds out what a
+ * pointer is (and which arena it goes back to) before it touches anything,
+ * and it is how the allocator tells the memory that it handed out apart from
+ * memory that it did not
+ *
+ * The interior nodes and leaves of the tree are fetched from the operating
+ * system the first time that a page under them is mapped and are never
+ * given back, parts of the address space that the allocator never uses cost
+ * nothing.  Entries are written when memory is fetched from (or given back
+ * to) the operating system and are read without any locks
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace eecs281 {
+
+/**
+ * The size of a page in the page map, this is the size of a slab
+ */
+constexpr auto PAGE_MAP_PAGE_BITS = 12;
+
+/**
+ * The kinds of pages.  NONE is a page that the allocator has not handed out
+ * any memory from, SLAB is a page in a slab segment, CHUNK is a page in a
+ * chunk of blocks that belongs to an arena and MAPPED is the page that the
+ * memory of a block with a mapping of its own starts on
+ */
+enum class PageKind : std::uint8_t {
+    NONE = 0,
+    SLAB = 1,
+    CHUNK = 2,
+    MAPPED = 3,
+};
+
+/**
+ * What the page map records about a page.  The arena is the index of the
+ * arena that owns a SLAB or a CHUNK page and -1 otherwise, and the
+ * descriptor is the slab of a SLAB page (which is the start of the page) or
+ * the header of the block of a MAPPED page, it is a nullptr otherwise
+ */
+struct PageEntry {
+    PageKind kind;
+    int arena;
+    void* descriptor;
+};
+
+/**
+ * Returns the entry of the page that the pointer lies in, this is an entry
+ * of kind NONE for any pointer that the allocator did not hand out
+ */
+PageEntry page_entry(const void* pointer);
+
+/**
+ * Records the entry for every page that overlaps the memory and clears the
+ * entries of those pages respectively.  The descriptor of a SLAB entry is
+ * not stored, it is always the start of the page that is looked up
+ *
+ * On error from the OS this function throws a std::bad_alloc exception to
+ * alert the user
+ *
+ * @param memory the start of the memory
+ * @param length the length of the memory in bytes
+ * @param entry the entry to record for the pages
+ */
+void map_pages(const void* memory, int length, PageEntry entry);
+void unmap_pages(const void* memory, int length);
+
+} // namespace eecs281
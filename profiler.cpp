@@ -0,0 +1,425 @@
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <utility>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "os_memory.hpp"
+#include "profiler.hpp"
+
+// the bounds of the section of the functions that are marked with
+// EECS281_ALLOCATOR_TEXT, these are defined by the linker
+extern "C" char __start_eecs281_text[];
+extern "C" char __stop_eecs281_text[];
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * The most frames of the allocator (and of the profiler) that can be at
+     * the top of a stack trace, these are taken on top of the frames that
+     * are recorded and then dropped
+     */
+    constexpr auto MAXIMUM_ALLOCATOR_FRAMES = 16;
+
+    /**
+     * The ranges of addresses that hold the code of the allocator, the
+     * executable segments of the shared library that it is built into or
+     * the section of the marked functions when it is linked into the
+     * program
+     */
+    struct AllocatorText {
+        static constexpr auto MAXIMUM_RANGES = 4;
+        std::uintptr_t begin[MAXIMUM_RANGES];
+        std::uintptr_t end[MAXIMUM_RANGES];
+        int number_ranges;
+    };
+
+    /**
+     * The state of the search for the allocator's code, the ranges that are
+     * found and the number of objects that have been looked through
+     */
+    struct TextSearch {
+        AllocatorText text;
+        int objects;
+    };
+
+    /**
+     * The number of bytes of sample records that are fetched from the
+     * operating system at once
+     */
+    constexpr auto SAMPLE_POOL_SIZE = 1 << 16;
+
+    /**
+     * The live samples and the records that are not in use, both are
+     * protected by the mutex.  Records come from the operating system rather
+     * than from malloc so that recording a sample does not go back into the
+     * allocator
+     */
+    std::mutex samples_mutex;
+    Sample* live_samples{nullptr};
+    Sample* free_samples{nullptr};
+    int number_live_samples{0};
+
+    /**
+     * Whether the fork handlers have been registered
+     */
+    std::atomic<bool> fork_handlers_registered{false};
+
+    /**
+     * Set while the calling thread is inside the profiler, the memory that
+     * the profiler allocates (for example when a stack trace is taken for
+     * the first time) is never sampled, otherwise the profiler would
+     * recurse into itself
+     */
+    thread_local bool in_profiler{false};
+
+    /**
+     * The state of the thread's random number generator, 0 before the
+     * generator has been seeded
+     */
+    thread_local std::uint64_t random_state{0};
+
+    /**
+     * Returns a random number that is uniformly distributed in (0, 1]
+     */
+    double random_fraction();
+
+    /**
+     * Returns true if the address is in the code of the allocator, the
+     * ranges are found by the first call.  The objects that are loaded are
+     * looked through with dl_iterate_phdr(3) for the one that holds the
+     * allocator, and the callback records its ranges
+     */
+    bool in_allocator(const void* address);
+    AllocatorText find_allocator_text();
+    int record_library_text(dl_phdr_info* info, std::size_t size,
+                            void* search);
+
+    /**
+     * Takes an unused sample record, fetching more records from the
+     * operating system if there are none, and gives a record back
+     * respectively.  The mutex must be held
+     */
+    Sample* take_record();
+    void give_back_record(Sample* sample);
+
+    /**
+     * Returns true if the two samples have the same stack trace, and
+     * whether the stack trace of the first sample orders before that of the
+     * second respectively
+     */
+    bool same_stack(const Sample& one, const Sample& two);
+    bool stack_before(const Sample& one, const Sample& two);
+
+    /**
+     * Copies the contents of the file to the stream, this reads the file
+     * with read(2) so that it does not allocate memory
+     */
+    void copy_file(const char* path, std::ostream& os);
+
+    /**
+     * The fork handlers, the samples are locked before a fork so that they
+     * are not copied into the child in the middle of an update
+     */
+    void lock_before_fork();
+    void unlock_after_fork();
+
+} // namespace <anonymous>
+
+
+std::int64_t sample_stride() {
+    auto interval = config().sample_interval;
+    if (!interval) {
+        return std::numeric_limits<std::int64_t>::max();
+    }
+
+    // the number of bytes to the next sample is -log(u) * interval for a
+    // uniform u, which is exponentially distributed with the interval as
+    // its mean
+    auto stride = -std::log(random_fraction()) * interval;
+    return static_cast<std::int64_t>(std::min(stride, 1e18)) + 1;
+}
+
+Sample* record_sample(int size) {
+    if (in_profiler || !config().sample_interval) {
+        return nullptr;
+    }
+    in_profiler = true;
+
+    // the handlers are registered when the first sample is recorded, which
+    // is before the mutex can be held by anything
+    if (!fork_handlers_registered.exchange(true)) {
+        pthread_atfork(lock_before_fork, unlock_after_fork,
+                unlock_after_fork);
+    }
+
+    // the stack trace starts at the caller of the allocator, the frames of
+    // the allocator on top of it are dropped
+    void* stack[MAXIMUM_SAMPLE_DEPTH + MAXIMUM_ALLOCATOR_FRAMES];
+    auto depth = backtrace(stack,
+            MAXIMUM_SAMPLE_DEPTH + MAXIMUM_ALLOCATOR_FRAMES);
+    auto first = 0;
+    while (first < depth && in_allocator(stack[first])) {
+        ++first;
+    }
+    depth = std::min(depth - first, MAXIMUM_SAMPLE_DEPTH);
+
+    auto sample = static_cast<Sample*>(nullptr);
+    {
+        std::lock_guard<std::mutex> lock{samples_mutex};
+        sample = take_record();
+        if (sample) {
+            sample->size = size;
+            sample->depth = depth;
+            std::copy(stack + first, stack + first + depth, sample->stack);
+
+            sample->previous = nullptr;
+            sample->next = live_samples;
+            if (live_samples) {
+                live_samples->previous = sample;
+            }
+            live_samples = sample;
+            ++number_live_samples;
+        }
+    }
+
+    in_profiler = false;
+    return sample;
+}
+
+void drop_sample(Sample* sample) {
+    assert(sample);
+    std::lock_guard<std::mutex> lock{samples_mutex};
+    if (sample->previous) {
+        sample->previous->next = sample->next;
+    } else {
+        assert(live_samples == sample);
+        live_samples = sample->next;
+    }
+    if (sample->next) {
+        sample->next->previous = sample->previous;
+    }
+    --number_live_samples;
+    give_back_record(sample);
+}
+
+void print_heap_profile(std::ostream& os) {
+    // the samples are copied out while the mutex is held and printed after
+    // it is released, since printing can allocate and free memory which
+    // might drop a sample.  Nothing that is allocated while the profile is
+    // printed is sampled
+    auto was_in_profiler = in_profiler;
+    in_profiler = true;
+    auto snapshot = std::pair<void*, int>{nullptr, 0};
+    auto number_samples = 0;
+    try {
+        std::lock_guard<std::mutex> lock{samples_mutex};
+        if (number_live_samples) {
+            snapshot = extend_heap(round_up_to_max_alignment(
+                        number_live_samples
+                        * static_cast<int>(sizeof(Sample))));
+            auto copies = static_cast<Sample*>(snapshot.first);
+            for (auto sample = live_samples; sample; sample = sample->next) {
+                copies[number_samples++] = *sample;
+            }
+        }
+    } catch (const std::bad_alloc&) {
+        in_profiler = was_in_profiler;
+        throw;
+    }
+    auto samples = static_cast<Sample*>(snapshot.first);
+
+    // merge the samples with the same stack trace, a record is printed with
+    // the number of samples and the number of sampled bytes and pprof
+    // scales both by the sampling interval
+    std::sort(samples, samples + number_samples, stack_before);
+    auto total_bytes = std::int64_t{0};
+    for (auto i = 0; i < number_samples; ++i) {
+        total_bytes += samples[i].size;
+    }
+    os << "heap profile: " << number_samples << ": " << total_bytes << " ["
+       << number_samples << ": " << total_bytes << "] @ heap_v2/"
+       << config().sample_interval << '\n';
+
+    auto flags = os.flags();
+    for (auto begin = 0; begin < number_samples;) {
+        auto end = begin;
+        auto bytes = std::int64_t{0};
+        while (end < number_samples && same_stack(samples[begin],
+                    samples[end])) {
+            bytes += samples[end++].size;
+        }
+        os << std::dec << (end - begin) << ": " << bytes << " ["
+           << (end - begin) << ": " << bytes << "] @" << std::hex;
+        for (auto frame = 0; frame < samples[begin].depth; ++frame) {
+            os << " 0x" << reinterpret_cast<std::uintptr_t>(
+                    samples[begin].stack[frame]);
+        }
+        os << '\n';
+        begin = end;
+    }
+    os.flags(flags);
+
+    os << "\nMAPPED_LIBRARIES:\n";
+    copy_file("/proc/self/maps", os);
+    os.flush();
+
+    if (snapshot.first) {
+        release_heap(snapshot.first, snapshot.second);
+    }
+    in_profiler = was_in_profiler;
+}
+
+namespace {
+
+    double random_fraction() {
+        // xorshift64*, seeded from the address of the state (which differs
+        // between threads) and the time
+        if (!random_state) {
+            random_state = reinterpret_cast<std::uintptr_t>(&random_state)
+                ^ static_cast<std::uint64_t>(std::chrono::steady_clock::now()
+                        .time_since_epoch().count());
+            random_state = random_state ? random_state : 1;
+        }
+        random_state ^= random_state >> 12;
+        random_state ^= random_state << 25;
+        random_state ^= random_state >> 27;
+        auto bits = (random_state * 0x2545f4914f6cdd1dULL) >> 11;
+        return static_cast<double>(bits + 1) / static_cast<double>(
+                std::uint64_t{1} << 53);
+    }
+
+    bool in_allocator(const void* address) {
+        static const auto text = find_allocator_text();
+        auto value = reinterpret_cast<std::uintptr_t>(address);
+        for (auto i = 0; i < text.number_ranges; ++i) {
+            if (value >= text.begin[i] && value < text.end[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    AllocatorText find_allocator_text() {
+        auto search = TextSearch{AllocatorText{}, 0};
+        dl_iterate_phdr(record_library_text, &search);
+        auto text = search.text;
+        if (!text.number_ranges) {
+            text.begin[0] = reinterpret_cast<std::uintptr_t>(
+                    __start_eecs281_text);
+            text.end[0] = reinterpret_cast<std::uintptr_t>(
+                    __stop_eecs281_text);
+            text.number_ranges = 1;
+        }
+        return text;
+    }
+
+    int record_library_text(dl_phdr_info* info, std::size_t,
+                            void* search) {
+        auto& state = *static_cast<TextSearch*>(search);
+        auto allocator = reinterpret_cast<std::uintptr_t>(&record_sample);
+        auto text = AllocatorText{};
+        auto holds_allocator = false;
+        for (auto i = 0; i < info->dlpi_phnum; ++i) {
+            auto& header = info->dlpi_phdr[i];
+            if (header.p_type != PT_LOAD || !(header.p_flags & PF_X)
+                    || text.number_ranges == AllocatorText::MAXIMUM_RANGES) {
+                continue;
+            }
+            auto begin = info->dlpi_addr + header.p_vaddr;
+            auto end = begin + header.p_memsz;
+            holds_allocator |= (allocator >= begin && allocator < end);
+            text.begin[text.number_ranges] = begin;
+            text.end[text.number_ranges++] = end;
+        }
+
+        // the first object is the program itself, if the allocator is
+        // linked into it then its code is mixed with the program's and no
+        // ranges are recorded
+        if (!holds_allocator) {
+            ++state.objects;
+            return 0;
+        }
+        if (state.objects) {
+            state.text = text;
+        }
+        return 1;
+    }
+
+    Sample* take_record() {
+        if (!free_samples) {
+            auto memory = std::pair<void*, int>{nullptr, 0};
+            try {
+                memory = extend_heap(SAMPLE_POOL_SIZE);
+            } catch (const std::bad_alloc&) {
+                return nullptr;
+            }
+            auto records = static_cast<Sample*>(memory.first);
+            auto number_records = memory.second
+                / static_cast<int>(sizeof(Sample));
+            for (auto i = 0; i < number_records; ++i) {
+                give_back_record(records + i);
+            }
+        }
+        auto sample = free_samples;
+        free_samples = sample->next;
+        return sample;
+    }
+
+    void give_back_record(Sample* sample) {
+        sample->next = free_samples;
+        free_samples = sample;
+    }
+
+    bool same_stack(const Sample& one, const Sample& two) {
+        return one.depth == two.depth
+            && std::equal(one.stack, one.stack + one.depth, two.stack);
+    }
+
+    bool stack_before(const Sample& one, const Sample& two) {
+        return std::lexicographical_compare(one.stack, one.stack + one.depth,
+                two.stack, two.stack + two.depth);
+    }
+
+    void copy_file(const char* path, std::ostream& os) {
+        auto file = open(path, O_RDONLY | O_CLOEXEC);
+        if (file < 0) {
+            return;
+        }
+        char buffer[4096];
+        for (;;) {
+            auto length = read(file, buffer, sizeof(buffer));
+            if (length <= 0) {
+                break;
+            }
+            os.write(buffer, length);
+        }
+        close(file);
+    }
+
+    void lock_before_fork() {
+        samples_mutex.lock();
+    }
+
+    void unlock_after_fork() {
+        samples_mutex.unlock();
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
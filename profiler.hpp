@@ -0,0 +1,104 @@
+/**
+ * @file profiler.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the sampling heap profiler.  Rather than recording
+ * every allocation, which would cost a stack trace on every call to malloc,
+ * the profiler samples on average one allocation in every sample_interval
+ * bytes (see config.hpp) and records the stack trace of only that
+ * allocation.  The number of bytes until the next sample is drawn from an
+ * exponential distribution (the continuous version of a geometric one), so
+ * every byte is equally likely to be sampled no matter the size or the
+ * pattern of the allocations, and an allocation of size bytes is sampled
+ * with probability 1 - exp(-size / sample_interval)
+ *
+ * The countdown to the next sample is kept by the allocator itself in the
+ * thread's cache, so an allocation that is not sampled costs a subtraction
+ * and a branch.  A sampled allocation is always a block (never a slab
+ * object) and its header points to its sample, so freeing it drops the
+ * sample in constant time
+ *
+ * The live samples can be dumped in the legacy text format of gperftools'
+ * heap profiles, which pprof reads and scales back up to estimates of the
+ * whole heap using the sampling interval in the header of the profile
+ *
+ *  EECS281_MALLOC_SAMPLE_BYTES=524288 ./program
+ *  pprof --text ./program heap.prof
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace eecs281 {
+
+/**
+ * The most frames that are recorded for a sample
+ */
+constexpr auto MAXIMUM_SAMPLE_DEPTH = 64;
+
+/**
+ * Marks a function of the allocator that can be on the stack when a sample
+ * is recorded.  The stack trace of a sample starts at the first frame that
+ * is not in the allocator, which depends on the entry point that was called
+ * and on what the compiler inlined, so the frames are told apart by
+ * address.  When the allocator is a shared library of its own (see
+ * sharpmalloc.cpp) every frame in the library is the allocator's, when it is
+ * linked into the program the marked functions are, which are kept in a
+ * section of their own.  GCC ignores the section of templates, the
+ * allocator's templates are inlined into their callers and show up as the
+ * callers' frames
+ */
+#define EECS281_ALLOCATOR_TEXT __attribute__((section("eecs281_text")))
+
+/**
+ * The record of a sampled allocation, the live samples are linked together
+ * so that they can be dumped
+ */
+struct Sample {
+    Sample* previous;
+    Sample* next;
+    int size;
+    int depth;
+    void* stack[MAXIMUM_SAMPLE_DEPTH];
+};
+
+/**
+ * Returns the number of bytes that the calling thread should allocate before
+ * the next sample, drawn from an exponential distribution with a mean of the
+ * sampling interval.  If the profiler is off this is so large that the
+ * thread never samples
+ */
+std::int64_t sample_stride();
+
+/**
+ * Records a sample for an allocation of size bytes made by the calling
+ * thread, with the stack trace of the caller.  This returns a nullptr if no
+ * sample can be recorded, which happens when the profiler is off, when the
+ * profiler itself allocates memory and when there is no memory for the
+ * record.  This must be called without any arena locked since taking a
+ * stack trace can allocate memory
+ *
+ * @param size the size of the allocation
+ *
+ * @return the sample, or a nullptr if the allocation is not sampled
+ */
+EECS281_ALLOCATOR_TEXT
+Sample* record_sample(int size);
+
+/**
+ * Drops the sample of an allocation that is being freed
+ */
+void drop_sample(Sample* sample);
+
+/**
+ * Prints the live samples as a heap profile in the format that pprof
+ * reads, samples with the same stack trace are merged, and the mappings of
+ * the process are appended so that pprof can symbolize the addresses
+ *
+ * @param os the stream to print the profile to
+ */
+void print_heap_profile(std::ostream& os);
+
+} // namespace eecs281
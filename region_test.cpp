@@ -0,0 +1,255 @@
+/**
+ * @file region_test.cpp
+ * @author Aaryaman Sagar
+ *
+ * Tests the region in Region.hpp, the pointer bump of the fast path, the
+ * move to a new chunk when the current one is full, the chunks of their own
+ * for memory that is too large for a chunk, the chunks that reset() keeps
+ * and reuses, the alignment of the memory, and that every chunk is given
+ * back to the operating system.  Whether a chunk is still mapped is asked of
+ * the kernel with mincore(2).  Build and run with
+ *
+ *  make check
+ */
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <new>
+#include <vector>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Region.hpp"
+
+using eecs281::Region;
+
+namespace {
+
+    /**
+     * The size of the chunks of the regions in the tests, a few pages
+     */
+    constexpr auto CHUNK_SIZE = 1 << 16;
+
+    /**
+     * A size that does not fit in a chunk of the tests
+     */
+    constexpr auto LARGE_SIZE = 1 << 18;
+
+    /**
+     * Returns whether the page that holds the address is mapped
+     */
+    bool is_mapped(const void* address);
+
+    /**
+     * Returns whether the address is aligned to the alignment
+     */
+    bool is_aligned(const void* address, int alignment);
+
+    /**
+     * The tests, each one asserts on failure
+     */
+    void test_fast_path();
+    void test_chunk_rollover();
+    void test_large_chunks();
+    void test_reset_keeps_chunks();
+    void test_reset_releases_chunks();
+    void test_destructor_releases_chunks();
+    void test_alignment();
+
+} // namespace <anonymous>
+
+int main() {
+    test_fast_path();
+    test_chunk_rollover();
+    test_large_chunks();
+    test_reset_keeps_chunks();
+    test_reset_releases_chunks();
+    test_destructor_releases_chunks();
+    test_alignment();
+
+    std::cout << "region_test passed" << std::endl;
+    return 0;
+}
+
+namespace {
+
+    bool is_mapped(const void* address) {
+        auto page = reinterpret_cast<std::uintptr_t>(address)
+            & ~static_cast<std::uintptr_t>(getpagesize() - 1);
+        unsigned char resident;
+        if (!mincore(reinterpret_cast<void*>(page), 1, &resident)) {
+            return true;
+        }
+        assert(errno == ENOMEM);
+        return false;
+    }
+
+    bool is_aligned(const void* address, int alignment) {
+        return !(reinterpret_cast<std::uintptr_t>(address) % alignment);
+    }
+
+    void test_fast_path() {
+        auto region = Region{CHUNK_SIZE};
+        assert(!region.mapped_bytes());
+
+        // the first allocation fetches a chunk, the rest bump the cursor
+        auto first = static_cast<char*>(region.allocate(3, 1));
+        assert(region.mapped_bytes() == CHUNK_SIZE);
+        auto second = static_cast<char*>(region.allocate(5, 1));
+        assert(second == first + 3);
+        auto third = static_cast<char*>(region.allocate(24));
+        assert(is_aligned(third, alignof(std::max_align_t)));
+        assert(third >= second + 5);
+        assert(third < second + 5 + alignof(std::max_align_t));
+        auto fourth = static_cast<char*>(region.allocate(24));
+        assert(fourth == third + 32);
+        assert(region.mapped_bytes() == CHUNK_SIZE);
+    }
+
+    void test_chunk_rollover() {
+        auto region = Region{CHUNK_SIZE};
+        auto first = static_cast<char*>(region.allocate(1024));
+
+        // fill the first chunk until an allocation moves to a second one,
+        // which has to come from outside the first chunk
+        auto last = first;
+        auto number = 1;
+        while (region.mapped_bytes() == CHUNK_SIZE) {
+            last = static_cast<char*>(region.allocate(1024));
+            ++number;
+        }
+        assert(number > 1 && number <= CHUNK_SIZE / 1024);
+        assert(region.mapped_bytes() == 2 * CHUNK_SIZE);
+        assert(last < first || last >= first + CHUNK_SIZE);
+
+        // and the allocations after that bump the cursor of the new chunk
+        auto next = static_cast<char*>(region.allocate(1024));
+        assert(next == last + 1024);
+    }
+
+    void test_large_chunks() {
+        auto region = Region{CHUNK_SIZE};
+        auto small = static_cast<char*>(region.allocate(64));
+        auto large = region.allocate(LARGE_SIZE);
+        assert(region.mapped_bytes() > CHUNK_SIZE + LARGE_SIZE);
+
+        // the large memory is out of the way of the current chunk, which
+        // goes on where it left off
+        auto large_begin = static_cast<char*>(large);
+        assert(small + 64 <= large_begin
+                || small >= large_begin + LARGE_SIZE);
+        auto next = static_cast<char*>(region.allocate(64));
+        assert(next == small + 64);
+
+        // the memory is usable
+        for (auto i = 0; i < LARGE_SIZE; i += getpagesize()) {
+            large_begin[i] = 1;
+        }
+        large_begin[LARGE_SIZE - 1] = 1;
+    }
+
+    void test_reset_keeps_chunks() {
+        auto region = Region{CHUNK_SIZE};
+        auto pointers = std::vector<void*>{};
+        while (region.mapped_bytes() < 3 * CHUNK_SIZE) {
+            pointers.push_back(region.allocate(1024));
+        }
+        auto large = region.allocate(LARGE_SIZE);
+        assert(region.mapped_bytes() > 3 * CHUNK_SIZE + LARGE_SIZE);
+
+        // the large chunk is given back and the others are kept
+        region.reset();
+        assert(region.mapped_bytes() == 3 * CHUNK_SIZE);
+        assert(!is_mapped(large));
+        for (auto pointer : pointers) {
+            assert(is_mapped(pointer));
+        }
+
+        // and the same allocations again fit in the kept chunks without
+        // fetching any new memory
+        auto kept = std::vector<void*>{};
+        for (auto i = std::size_t{0}; i < pointers.size(); ++i) {
+            kept.push_back(region.allocate(1024));
+        }
+        assert(region.mapped_bytes() == 3 * CHUNK_SIZE);
+        for (auto pointer : kept) {
+            assert(is_mapped(pointer));
+        }
+
+        // release() gives back the kept chunks too
+        region.release();
+        assert(!region.mapped_bytes());
+        for (auto pointer : pointers) {
+            assert(!is_mapped(pointer));
+        }
+    }
+
+    void test_reset_releases_chunks() {
+        auto region = Region{CHUNK_SIZE, false};
+        auto pointers = std::vector<void*>{};
+        while (region.mapped_bytes() < 2 * CHUNK_SIZE) {
+            pointers.push_back(region.allocate(1024));
+        }
+        pointers.push_back(region.allocate(LARGE_SIZE));
+
+        region.reset();
+        assert(!region.mapped_bytes());
+        for (auto pointer : pointers) {
+            assert(!is_mapped(pointer));
+        }
+
+        // the region can be used again after that
+        auto pointer = region.allocate(1024);
+        assert(region.mapped_bytes() == CHUNK_SIZE);
+        assert(is_mapped(pointer));
+    }
+
+    void test_destructor_releases_chunks() {
+        auto pointers = std::vector<void*>{};
+        {
+            auto region = Region{CHUNK_SIZE};
+            while (region.mapped_bytes() < 2 * CHUNK_SIZE) {
+                pointers.push_back(region.allocate(1024));
+            }
+            pointers.push_back(region.allocate(LARGE_SIZE));
+
+            // a reset leaves chunks that only the destructor gives back
+            region.reset();
+            pointers.push_back(region.allocate(1024));
+            pointers.push_back(region.allocate(LARGE_SIZE));
+        }
+        for (auto pointer : pointers) {
+            assert(!is_mapped(pointer));
+        }
+    }
+
+    void test_alignment() {
+        auto region = Region{CHUNK_SIZE};
+        for (auto alignment = 1; alignment <= getpagesize(); alignment *= 2) {
+            region.allocate(1, 1);
+            auto pointer = region.allocate(alignment, alignment);
+            assert(is_aligned(pointer, alignment));
+        }
+
+        // the padding is taken into account for memory in a chunk of its
+        // own, and for memory that only fits in a new chunk with it
+        auto large = region.allocate(LARGE_SIZE, 1 << 16);
+        assert(is_aligned(large, 1 << 16));
+        static_cast<char*>(large)[LARGE_SIZE - 1] = 1;
+        auto padded = region.allocate(CHUNK_SIZE / 2, CHUNK_SIZE / 4);
+        assert(is_aligned(padded, CHUNK_SIZE / 4));
+        static_cast<char*>(padded)[CHUNK_SIZE / 2 - 1] = 1;
+
+        // requests that cannot be met throw
+        auto threw = false;
+        try {
+            region.allocate(-1);
+        } catch (std::bad_alloc&) {
+            threw = true;
+        }
+        assert(threw);
+    }
+
+} // namespace <anonymous>
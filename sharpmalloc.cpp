@@ -0,0 +1,361 @@
+/**
+ * @file sharpmalloc.cpp
+ * @author Aaryaman Sagar
+ *
+ * This file exports the allocator under the names of the C library's
+ * allocation functions and of the C++ allocation operators, so that when it
+ * is built into libsharpmalloc.so the library can be preloaded into any
+ * dynamically linked program and take over all of its memory management
+ * without the program being rebuilt
+ *
+ *  make libsharpmalloc.so
+ *  LD_PRELOAD=./libsharpmalloc.so ./program
+ *
+ * The functions here only translate between the C interfaces and the
+ * interface in eecs281malloc.hpp.  Sizes are size_t here and int there, so a
+ * request that is too large for an int fails like any other request that
+ * cannot be served.  The C functions report failure by returning a nullptr
+ * and setting errno (or by returning the error for posix_memalign()) rather
+ * than with an exception, and operator new calls the new handler before it
+ * gives up and throws.  The sized versions of operator delete pass the size
+ * on to eecs281::free_sized()
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <unistd.h>
+
+#include "eecs281malloc.hpp"
+#include "profiler.hpp"
+
+/**
+ * The library is built with hidden visibility, this marks the functions that
+ * make up its interface
+ */
+#define SHARPMALLOC_EXPORT __attribute__((visibility("default")))
+
+namespace {
+
+    /**
+     * The largest request that is passed on to the allocator
+     */
+    constexpr auto MAXIMUM_REQUEST = static_cast<std::size_t>(
+            eecs281::MAXIMUM_REQUEST);
+
+    /**
+     * Runs the allocation with the amount as an int and returns its result,
+     * or a nullptr with errno set to ENOMEM if the amount is too large or
+     * there is no memory
+     */
+    template <typename Allocate>
+    void* allocate_or_null(std::size_t amount, Allocate allocate) noexcept;
+
+    /**
+     * Allocates memory for operator new, calling the new handler until
+     * either the memory can be allocated or there is no new handler, in
+     * which case this throws a std::bad_alloc
+     */
+    void* allocate_for_new(std::size_t amount, std::size_t alignment);
+
+} // namespace <anonymous>
+
+
+extern "C" {
+
+SHARPMALLOC_EXPORT void* malloc(std::size_t amount) noexcept {
+    return allocate_or_null(amount, [](int size) {
+        return eecs281::malloc(size);
+    });
+}
+
+SHARPMALLOC_EXPORT void free(void* pointer) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void* calloc(std::size_t number, std::size_t size)
+        noexcept {
+    if (size && number > MAXIMUM_REQUEST / size) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return allocate_or_null(number * size, [](int amount) {
+        return eecs281::calloc(amount, 1);
+    });
+}
+
+SHARPMALLOC_EXPORT void* realloc(void* pointer, std::size_t amount)
+        noexcept {
+    // realloc(3) leaves the memory alone when it fails, so the size is only
+    // checked after a nullptr (which is a malloc) and a 0 (which is a free)
+    if (pointer && !amount) {
+        eecs281::free(pointer);
+        return nullptr;
+    }
+    return allocate_or_null(amount, [pointer](int size) {
+        return eecs281::realloc(pointer, size);
+    });
+}
+
+SHARPMALLOC_EXPORT int posix_memalign(void** pointer, std::size_t alignment,
+                                      std::size_t amount) noexcept {
+    if (alignment > MAXIMUM_REQUEST) {
+        return EINVAL;
+    }
+    if (amount > MAXIMUM_REQUEST - alignment) {
+        return ENOMEM;
+    }
+    return eecs281::posix_memalign(pointer, static_cast<int>(alignment),
+            static_cast<int>(amount));
+}
+
+SHARPMALLOC_EXPORT void* aligned_alloc(std::size_t alignment,
+                                       std::size_t amount) noexcept {
+    if (!alignment || (alignment & (alignment - 1))
+            || alignment > MAXIMUM_REQUEST) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    if (amount > MAXIMUM_REQUEST - alignment) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return allocate_or_null(amount, [alignment](int size) {
+        return eecs281::aligned_alloc(static_cast<int>(alignment), size);
+    });
+}
+
+/**
+ * The obsolete aligned allocation functions, these are still used by some
+ * programs and by parts of the C library itself so they have to come from
+ * the same allocator as free()
+ */
+SHARPMALLOC_EXPORT void* memalign(std::size_t alignment, std::size_t amount)
+        noexcept {
+    return aligned_alloc(alignment, amount);
+}
+
+SHARPMALLOC_EXPORT void* valloc(std::size_t amount) noexcept {
+    return aligned_alloc(static_cast<std::size_t>(getpagesize()), amount);
+}
+
+SHARPMALLOC_EXPORT void* pvalloc(std::size_t amount) noexcept {
+    auto page_size = static_cast<std::size_t>(getpagesize());
+    return aligned_alloc(page_size,
+            (amount + page_size - 1) & ~(page_size - 1));
+}
+
+/**
+ * The C23 deallocation functions that take the size of the memory, the size
+ * of memory from an aligned allocation is not used since it might have come
+ * from a different place than memory of the same size from malloc()
+ */
+SHARPMALLOC_EXPORT void free_sized(void* pointer, std::size_t amount)
+        noexcept {
+    if (amount > MAXIMUM_REQUEST) {
+        eecs281::free(pointer);
+        return;
+    }
+    eecs281::free_sized(pointer, static_cast<int>(amount));
+}
+
+SHARPMALLOC_EXPORT void free_aligned_sized(void* pointer, std::size_t,
+                                           std::size_t) noexcept {
+    eecs281::free(pointer);
+}
+
+/**
+ * Prints the statistics of the allocator to stderr like malloc_stats(3) in
+ * glibc, the snapshot is taken before anything is printed since printing
+ * can allocate memory
+ */
+SHARPMALLOC_EXPORT void malloc_stats() noexcept {
+    try {
+        eecs281::print_statistics(std::cerr, eecs281::statistics());
+    } catch (...) {
+    }
+}
+
+/**
+ * Writes the heap profile to the file at the given path (see profiler.hpp),
+ * this is how a program that has the library preloaded can dump its profile,
+ * for example from a debugger or a signal handler that defers to a thread.
+ * Returns 0 on success and an errno value if the file cannot be written
+ */
+SHARPMALLOC_EXPORT int sharpmalloc_dump_heap_profile(const char* path)
+        noexcept {
+    try {
+        auto file = std::ofstream{path};
+        if (!file) {
+            return errno ? errno : EIO;
+        }
+        eecs281::print_heap_profile(file);
+        return file ? 0 : EIO;
+    } catch (...) {
+        return ENOMEM;
+    }
+}
+
+SHARPMALLOC_EXPORT std::size_t malloc_usable_size(void* pointer) noexcept {
+    if (!pointer) {
+        return 0;
+    }
+    return static_cast<std::size_t>(eecs281::malloc_usable_size(pointer));
+}
+
+} // extern "C"
+
+
+SHARPMALLOC_EXPORT void* operator new(std::size_t amount) {
+    return allocate_for_new(amount, 0);
+}
+
+SHARPMALLOC_EXPORT void* operator new[](std::size_t amount) {
+    return allocate_for_new(amount, 0);
+}
+
+SHARPMALLOC_EXPORT void* operator new(std::size_t amount,
+                                      const std::nothrow_t&) noexcept {
+    try {
+        return allocate_for_new(amount, 0);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+SHARPMALLOC_EXPORT void* operator new[](std::size_t amount,
+                                        const std::nothrow_t&) noexcept {
+    try {
+        return allocate_for_new(amount, 0);
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+SHARPMALLOC_EXPORT void operator delete(void* pointer) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete[](void* pointer) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete(void* pointer, std::size_t amount)
+        noexcept {
+    free_sized(pointer, amount);
+}
+
+SHARPMALLOC_EXPORT void operator delete[](void* pointer, std::size_t amount)
+        noexcept {
+    free_sized(pointer, amount);
+}
+
+SHARPMALLOC_EXPORT void operator delete(void* pointer,
+                                        const std::nothrow_t&) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete[](void* pointer,
+                                          const std::nothrow_t&) noexcept {
+    eecs281::free(pointer);
+}
+
+#if __cpp_aligned_new
+
+SHARPMALLOC_EXPORT void* operator new(std::size_t amount,
+                                      std::align_val_t alignment) {
+    return allocate_for_new(amount, static_cast<std::size_t>(alignment));
+}
+
+SHARPMALLOC_EXPORT void* operator new[](std::size_t amount,
+                                        std::align_val_t alignment) {
+    return allocate_for_new(amount, static_cast<std::size_t>(alignment));
+}
+
+SHARPMALLOC_EXPORT void* operator new(std::size_t amount,
+                                      std::align_val_t alignment,
+                                      const std::nothrow_t&) noexcept {
+    try {
+        return allocate_for_new(amount, static_cast<std::size_t>(alignment));
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+SHARPMALLOC_EXPORT void* operator new[](std::size_t amount,
+                                        std::align_val_t alignment,
+                                        const std::nothrow_t&) noexcept {
+    try {
+        return allocate_for_new(amount, static_cast<std::size_t>(alignment));
+    } catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+SHARPMALLOC_EXPORT void operator delete(void* pointer, std::align_val_t)
+        noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete[](void* pointer, std::align_val_t)
+        noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete(void* pointer, std::size_t,
+                                        std::align_val_t) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete[](void* pointer, std::size_t,
+                                          std::align_val_t) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete(void* pointer, std::align_val_t,
+                                        const std::nothrow_t&) noexcept {
+    eecs281::free(pointer);
+}
+
+SHARPMALLOC_EXPORT void operator delete[](void* pointer, std::align_val_t,
+                                          const std::nothrow_t&) noexcept {
+    eecs281::free(pointer);
+}
+
+#endif
+
+
+namespace {
+
+    template <typename Allocate>
+    void* allocate_or_null(std::size_t amount, Allocate allocate) noexcept {
+        if (amount > MAXIMUM_REQUEST) {
+            errno = ENOMEM;
+            return nullptr;
+        }
+        try {
+            return allocate(static_cast<int>(amount));
+        } catch (const std::bad_alloc&) {
+            errno = ENOMEM;
+            return nullptr;
+        }
+    }
+
+    void* allocate_for_new(std::size_t amount, std::size_t alignment) {
+        for (;;) {
+            auto pointer = alignment ? aligned_alloc(alignment, amount)
+                : malloc(amount);
+            if (pointer) {
+                return pointer;
+            }
+            auto handler = std::get_new_handler();
+            if (!handler) {
+                throw std::bad_alloc{};
+            }
+            handler();
+        }
+    }
+
+} // namespace <anonymous>
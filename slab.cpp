@@ -0,0 +1,109 @@
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+#include <new>
+
+#include "pagemap.hpp"
+#include "slab.hpp"
+
+using std::uintptr_t;
+using std::max_align_t;
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * The page map records slab pages, so a slab has to be exactly one page
+     * of the map for its descriptor to be the start of the page
+     */
+    static_assert((1 << PAGE_MAP_PAGE_BITS) == SLAB_SIZE,
+            "The pages of the page map do not match the size of a slab");
+
+    /**
+     * Returns the address of the first object in the slab, the objects start
+     * right after the descriptor
+     */
+    uintptr_t first_object(Slab_t* slab);
+
+} // namespace <anonymous>
+
+
+int slab_class(int amount) {
+    assert(amount > 0 && amount <= SLAB_LIMIT);
+    assert(!(amount % alignof(max_align_t)));
+    return amount / static_cast<int>(alignof(max_align_t)) - 1;
+}
+
+Slab_t* make_slab(void* page, int size_class, int arena) {
+    assert(!(reinterpret_cast<uintptr_t>(page) % SLAB_SIZE));
+    assert(size_class >= 0 && size_class < NUMBER_SLAB_CLASSES);
+    assert(is_slab_pointer(page));
+
+    auto object_size = (size_class + 1)
+        * static_cast<int>(alignof(max_align_t));
+    auto number_objects = static_cast<int>(
+            (SLAB_SIZE - sizeof(Slab_t)) / object_size);
+    auto slab = new(page) Slab_t{SlabMetadata{object_size, number_objects,
+        number_objects, static_cast<std::uint16_t>(arena),
+        static_cast<std::uint16_t>(size_class), {}}};
+
+    // mark every object in the slab as free, the bits past the last object
+    // are left clear so that they are never allocated
+    for (auto i = 0; i < number_objects; ++i) {
+        slab->datum.bitmap[i / 64] |= std::uint64_t{1} << (i % 64);
+    }
+    return slab;
+}
+
+void* slab_allocate(Slab_t* slab) {
+    assert(slab->datum.number_free > 0);
+
+    // find the first word with a free object in it and then the first free
+    // object in that word
+    auto word = 0;
+    while (!slab->datum.bitmap[word]) {
+        ++word;
+        assert(word < SLAB_BITMAP_WORDS);
+    }
+    auto bit = __builtin_ctzll(slab->datum.bitmap[word]);
+    slab->datum.bitmap[word] &= ~(std::uint64_t{1} << bit);
+    --slab->datum.number_free;
+
+    auto index = word * 64 + bit;
+    assert(index < slab->datum.number_objects);
+    return reinterpret_cast<void*>(first_object(slab)
+            + index * slab->datum.object_size);
+}
+
+void slab_deallocate(Slab_t* slab, void* pointer) {
+    auto offset = reinterpret_cast<uintptr_t>(pointer) - first_object(slab);
+    assert(!(offset % slab->datum.object_size));
+    auto index = static_cast<int>(offset / slab->datum.object_size);
+    assert(index < slab->datum.number_objects);
+
+    auto mask = std::uint64_t{1} << (index % 64);
+    assert(!(slab->datum.bitmap[index / 64] & mask));
+    slab->datum.bitmap[index / 64] |= mask;
+    ++slab->datum.number_free;
+}
+
+Slab_t* slab_from_pointer(void* pointer) {
+    assert(is_slab_pointer(pointer));
+    return reinterpret_cast<Slab_t*>(reinterpret_cast<uintptr_t>(pointer)
+            & ~static_cast<uintptr_t>(SLAB_SIZE - 1));
+}
+
+bool is_slab_pointer(const void* pointer) {
+    return page_entry(pointer).kind == PageKind::SLAB;
+}
+
+namespace {
+
+    uintptr_t first_object(Slab_t* slab) {
+        return reinterpret_cast<uintptr_t>(slab + 1);
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
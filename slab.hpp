@@ -0,0 +1,121 @@
+/**
+ * @file slab.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the slabs that small objects are allocated from.  A
+ * slab is a SLAB_SIZE aligned page that holds objects of exactly one size,
+ * it starts with a descriptor and the rest of the page is an array of
+ * objects.  The descriptor keeps a bitmap with one bit for every object in
+ * the slab that is set when the object is free, so allocating an object is
+ * a find-first-set on the bitmap.  Objects carry no header at all, the slab
+ * that an object belongs to (and so its size) is found by rounding the
+ * address of the object down to the slab boundary
+ *
+ * Slabs are carved out of SLAB_SEGMENT_SIZE aligned segments of memory from
+ * the operating system, and every page of a segment is recorded in the page
+ * map (see pagemap.hpp).  That map is what free() uses to tell a headerless
+ * slab object apart from a block with a header
+ *
+ * Like the functions in block.hpp, these only touch the slab that is passed
+ * in, synchronizing access to the slab is left to the caller
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "TransparentList.hpp"
+
+namespace eecs281 {
+
+/**
+ * The size and alignment of a slab and of the segments that slabs are
+ * carved out of
+ */
+constexpr auto SLAB_SIZE = 4096;
+constexpr auto SLAB_SEGMENT_SIZE = 1 << 21;
+
+/**
+ * Requests of up to SLAB_LIMIT bytes are served from slabs, there is one
+ * slab size class for every multiple of the maximum alignment up to the
+ * limit
+ */
+constexpr auto SLAB_LIMIT = 256;
+constexpr auto NUMBER_SLAB_CLASSES = static_cast<int>(
+        SLAB_LIMIT / alignof(std::max_align_t));
+
+/**
+ * The number of 64 bit words in the free bitmap of a slab, enough for a slab
+ * full of objects of the smallest size class
+ */
+constexpr auto SLAB_BITMAP_WORDS = static_cast<int>(
+        SLAB_SIZE / alignof(std::max_align_t) / 64);
+
+/**
+ * The descriptor at the start of every slab.  The object size is the size of
+ * every object in the slab, the arena is the index of the arena that owns
+ * the slab and a bit in the bitmap is set when the corresponding object is
+ * free
+ */
+struct SlabMetadata {
+    int object_size;
+    int number_objects;
+    int number_free;
+    std::uint16_t arena;
+    std::uint16_t size_class;
+    std::uint64_t bitmap[SLAB_BITMAP_WORDS];
+};
+
+/**
+ * Typedefs for the list of slabs and for a slab, slabs are linked into the
+ * per size class lists of their arena through their descriptor
+ */
+using SlabList_t = TransparentList<SlabMetadata>;
+using Slab_t = TransparentNode<SlabMetadata>;
+
+static_assert(sizeof(Slab_t) < SLAB_SIZE / 8,
+        "The slab descriptor takes up too much of the slab");
+
+/**
+ * Returns the slab size class that a request of amount bytes is served from
+ *
+ * @param amount the size of the request, this should be a positive multiple
+ *        of the maximum alignment on the system that is at most SLAB_LIMIT
+ */
+int slab_class(int amount);
+
+/**
+ * Constructs an empty slab in the SLAB_SIZE aligned page passed in, every
+ * object in the slab is free
+ *
+ * @param page the page to make the slab in, it should lie in a segment that
+ *        has been recorded in the page map
+ * @param size_class the size class of the objects in the slab
+ * @param arena the index of the arena that owns the slab
+ *
+ * @return the descriptor of the slab
+ */
+Slab_t* make_slab(void* page, int size_class, int arena);
+
+/**
+ * Allocates an object from the slab and frees an object back to the slab
+ * respectively.  The slab should have a free object when allocating from it
+ */
+void* slab_allocate(Slab_t* slab);
+void slab_deallocate(Slab_t* slab, void* pointer);
+
+/**
+ * Returns the slab that the object belongs to, the pointer must be a slab
+ * object as determined by is_slab_pointer()
+ */
+Slab_t* slab_from_pointer(void* pointer);
+
+/**
+ * Returns true if the pointer lies in a slab segment, i.e. if it is a
+ * headerless slab object.  This only reads the page map and never the
+ * memory around the pointer
+ */
+bool is_slab_pointer(const void* pointer);
+
+} // namespace eecs281
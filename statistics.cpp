@@ -0,0 +1,102 @@
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+#include "statistics.hpp"
+
+namespace eecs281 {
+
+namespace {
+
+    /**
+     * Returns the fraction of the free bytes that are outside the largest
+     * free block, 0 means that all free memory can serve one request and
+     * values close to 1 mean that it is split into many small pieces
+     */
+    double fragmentation(const Statistics& statistics);
+
+    /**
+     * Print the statistics in each of the formats
+     */
+    void print_text(std::ostream& os, const Statistics& statistics);
+    void print_json(std::ostream& os, const Statistics& statistics);
+
+} // namespace <anonymous>
+
+
+void print_statistics(std::ostream& os, const Statistics& statistics,
+                      StatisticsFormat format) {
+    if (format == StatisticsFormat::JSON) {
+        print_json(os, statistics);
+    } else {
+        print_text(os, statistics);
+    }
+}
+
+namespace {
+
+    double fragmentation(const Statistics& statistics) {
+        if (!statistics.free_bytes) {
+            return 0.0;
+        }
+        return 1.0 - static_cast<double>(statistics.largest_free_block)
+            / static_cast<double>(statistics.free_bytes);
+    }
+
+    void print_text(std::ostream& os, const Statistics& statistics) {
+        auto flags = os.flags();
+        os << "mapped bytes:        " << statistics.mapped_bytes << '\n'
+           << "allocated bytes:     " << statistics.allocated_bytes << '\n'
+           << "free bytes:          " << statistics.free_bytes << '\n'
+           << "free blocks:         " << statistics.free_blocks << '\n'
+           << "largest free block:  " << statistics.largest_free_block << '\n'
+           << "fragmentation:       " << std::fixed << std::setprecision(3)
+           << fragmentation(statistics) << '\n'
+           << "pages purged:        " << statistics.pages_purged << '\n'
+           << "pages reused:        " << statistics.pages_reused << '\n'
+           << '\n'
+           << std::setw(12) << "size class" << std::setw(16) << "mallocs"
+           << std::setw(16) << "frees" << std::setw(16) << "live" << '\n';
+        for (const auto& size_class : statistics.size_classes) {
+            if (!size_class.mallocs && !size_class.frees) {
+                continue;
+            }
+            os << std::setw(12) << size_class.maximum_size
+               << std::setw(16) << size_class.mallocs
+               << std::setw(16) << size_class.frees
+               << std::setw(16) << static_cast<std::int64_t>(
+                       size_class.mallocs - size_class.frees) << '\n';
+        }
+        os.flags(flags);
+    }
+
+    void print_json(std::ostream& os, const Statistics& statistics) {
+        auto flags = os.flags();
+        os << "{\"mapped_bytes\":" << statistics.mapped_bytes
+           << ",\"allocated_bytes\":" << statistics.allocated_bytes
+           << ",\"free_bytes\":" << statistics.free_bytes
+           << ",\"free_blocks\":" << statistics.free_blocks
+           << ",\"largest_free_block\":" << statistics.largest_free_block
+           << ",\"fragmentation\":" << std::fixed << std::setprecision(6)
+           << fragmentation(statistics)
+           << ",\"pages_purged\":" << statistics.pages_purged
+           << ",\"pages_reused\":" << statistics.pages_reused
+           << ",\"size_classes\":[";
+        auto first = true;
+        for (const auto& size_class : statistics.size_classes) {
+            if (!size_class.mallocs && !size_class.frees) {
+                continue;
+            }
+            os << (first ? "" : ",")
+               << "{\"maximum_size\":" << size_class.maximum_size
+               << ",\"mallocs\":" << size_class.mallocs
+               << ",\"frees\":" << size_class.frees << '}';
+            first = false;
+        }
+        os << "]}\n";
+        os.flags(flags);
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
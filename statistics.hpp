@@ -0,0 +1,110 @@
+/**
+ * @file statistics.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the statistics that the allocator keeps about the
+ * memory that it manages.  None of these are computed by walking the heap,
+ * they are counters that are kept up to date as memory is allocated and
+ * freed, so taking a snapshot of them is cheap enough to do periodically in
+ * production (for example to alert on fragmentation or to decide how much
+ * memory a program needs)
+ *
+ * A snapshot is taken with eecs281::statistics() and can be printed either
+ * as text for people to read or as JSON for other programs to read
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace eecs281 {
+
+/**
+ * The number of size classes that allocations are counted in, these are the
+ * same as the bins of the arenas.  There is one class for every multiple of
+ * the maximum alignment up to 512 bytes and one class for every power of two
+ * range of sizes above that
+ */
+constexpr auto NUMBER_SIZE_CLASSES = 54;
+
+/**
+ * The counts for the allocations of one size class, an allocation is
+ * counted in the class of the size of the memory that it got (which is at
+ * least the size that was requested), so mallocs - frees is the number of
+ * allocations of the class that are live
+ */
+struct SizeClassStatistics {
+
+    /**
+     * The largest size in bytes that is in the class
+     */
+    int maximum_size;
+
+    std::uint64_t mallocs;
+    std::uint64_t frees;
+};
+
+/**
+ * A snapshot of the statistics of the allocator, summed over every arena and
+ * every thread
+ */
+struct Statistics {
+
+    /**
+     * The number of bytes mapped from the operating system, this is the
+     * chunks and slab segments of the arenas and the mappings of blocks that
+     * have a mapping of their own.  Pages that have been purged are still
+     * mapped, they are counted in pages_purged
+     */
+    std::uint64_t mapped_bytes;
+
+    /**
+     * The number of usable bytes in memory that has been handed out, memory
+     * that sits in the cache of a thread or of a CPU counts as handed out
+     * since it is not available to the arenas
+     */
+    std::uint64_t allocated_bytes;
+
+    /**
+     * The number of bytes in free blocks in the arenas, the number of free
+     * blocks that they are split across and the size of the largest one.  A
+     * large amount of free memory that is split into many small blocks
+     * means that the heap is fragmented
+     */
+    std::uint64_t free_bytes;
+    std::uint64_t free_blocks;
+    std::uint64_t largest_free_block;
+
+    /**
+     * The purge counters, see PurgeStatistics
+     */
+    std::uint64_t pages_purged;
+    std::uint64_t pages_reused;
+
+    /**
+     * The number of allocations and frees in every size class, in order of
+     * size
+     */
+    SizeClassStatistics size_classes[NUMBER_SIZE_CLASSES];
+};
+
+/**
+ * The formats that the statistics can be printed in
+ */
+enum class StatisticsFormat { TEXT, JSON };
+
+/**
+ * Prints the statistics, size classes that have never been used are left
+ * out.  Along with the counters this prints the fragmentation of the free
+ * memory, which is the fraction of the free bytes that are not in the
+ * largest free block
+ *
+ * @param os the stream to print to
+ * @param statistics the snapshot to print
+ * @param format whether to print text or a single JSON object
+ */
+void print_statistics(std::ostream& os, const Statistics& statistics,
+                      StatisticsFormat format = StatisticsFormat::TEXT);
+
+} // namespace eecs281
@@ -0,0 +1,167 @@
+/**
+ * @file tlb_benchmark.cpp
+ * @author Aaryaman Sagar
+ *
+ * A benchmark of a TLB sensitive workload, comparing a heap backed by
+ * regular pages with one backed by huge pages.  The benchmark allocates a
+ * large number of small nodes of varying sizes, links them together in a
+ * random order and then chases the pointers around the list.  Every hop is
+ * to a node that is usually on a different page than the one before, so the
+ * time per hop is dominated by cache and TLB misses, and huge pages cut
+ * down on the TLB misses
+ *
+ * Since the settings of the allocator are read once per process the
+ * benchmark runs itself once for every setting of EECS281_MALLOC_HUGE_PAGES
+ * and prints one row for each run.  The resident huge pages are read from
+ * /proc/self/smaps_rollup, where they show up as AnonHugePages
+ *
+ * Build and run with
+ *
+ *  make tlb_benchmark
+ *  ./tlb_benchmark [number of nodes]
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "eecs281malloc.hpp"
+
+namespace {
+
+    /**
+     * The parameters of the workload, most nodes are small enough to come
+     * from slabs and one in eight is large enough to be a block on the heap
+     */
+    constexpr auto DEFAULT_NUMBER_NODES = 500000;
+    constexpr auto NUMBER_HOPS = 20000000;
+    constexpr auto MAXIMUM_SMALL_SIZE = 256;
+    constexpr auto MAXIMUM_LARGE_SIZE = 1024;
+
+    /**
+     * The flag that tells the benchmark that it has been run by itself with
+     * the environment set up for one of the settings
+     */
+    constexpr auto RUN_FLAG = "--run";
+
+    struct Node {
+        Node* next;
+    };
+
+    /**
+     * Where the end of the chase is stored so that it is not optimized away
+     */
+    Node* volatile last_node;
+
+    /**
+     * Returns the number of kilobytes of anonymous memory that is backed by
+     * transparent huge pages in this process, or -1 if the kernel does not
+     * report it
+     */
+    long anonymous_huge_kilobytes() {
+        auto smaps = std::ifstream{"/proc/self/smaps_rollup"};
+        auto line = std::string{};
+        while (std::getline(smaps, line)) {
+            if (line.compare(0, 14, "AnonHugePages:") == 0) {
+                return std::atol(line.c_str() + 14);
+            }
+        }
+        return -1;
+    }
+
+    /**
+     * Allocates the nodes, links them in a random cycle and chases the
+     * pointers around it, then prints the time per hop
+     */
+    void run(int number_nodes) {
+        auto engine = std::mt19937{1};
+        auto small = std::uniform_int_distribution<int>{
+            static_cast<int>(sizeof(Node)), MAXIMUM_SMALL_SIZE};
+        auto large = std::uniform_int_distribution<int>{
+            MAXIMUM_SMALL_SIZE + 1, MAXIMUM_LARGE_SIZE};
+
+        auto nodes = std::vector<Node*>(number_nodes);
+        for (auto& node : nodes) {
+            auto amount = (engine() % 8) ? small(engine) : large(engine);
+            node = static_cast<Node*>(eecs281::malloc(amount));
+            std::memset(node, 0, amount);
+        }
+        auto order = nodes;
+        std::shuffle(order.begin(), order.end(), engine);
+        for (auto i = 0; i < number_nodes; ++i) {
+            order[i]->next = order[(i + 1) % number_nodes];
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto current = order.front();
+        for (auto i = 0; i < NUMBER_HOPS; ++i) {
+            current = current->next;
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>{
+            std::chrono::steady_clock::now() - start};
+        last_node = current;
+
+        auto setting = std::getenv("EECS281_MALLOC_HUGE_PAGES");
+        std::cout << std::setw(12) << (setting ? setting : "0")
+                  << std::setw(12) << std::fixed << std::setprecision(2)
+                  << elapsed.count() / NUMBER_HOPS
+                  << std::setw(20) << anonymous_huge_kilobytes() << std::endl;
+
+        for (auto node : nodes) {
+            eecs281::free(node);
+        }
+    }
+
+    /**
+     * Runs the benchmark in a child process with the huge page setting in
+     * its environment
+     */
+    void run_with_setting(const char* program, const char* setting,
+                          const char* number_nodes) {
+        auto child = fork();
+        if (child < 0) {
+            std::perror("fork");
+            return;
+        }
+        if (!child) {
+            setenv("EECS281_MALLOC_HUGE_PAGES", setting, 1);
+            auto arguments = std::vector<char*>{const_cast<char*>(program),
+                const_cast<char*>(RUN_FLAG),
+                const_cast<char*>(number_nodes), nullptr};
+            execv("/proc/self/exe", arguments.data());
+            std::perror("execv");
+            std::_Exit(1);
+        }
+        auto status = 0;
+        waitpid(child, &status, 0);
+    }
+
+} // namespace <anonymous>
+
+
+int main(int argc, char** argv) {
+    if (argc > 2 && !std::strcmp(argv[1], RUN_FLAG)) {
+        run(std::atoi(argv[2]));
+        return 0;
+    }
+
+    auto number_nodes = std::to_string((argc > 1) ? std::atoi(argv[1])
+            : DEFAULT_NUMBER_NODES);
+    std::cout << std::setw(12) << "huge pages" << std::setw(12) << "ns/hop"
+              << std::setw(20) << "AnonHugePages kB" << std::endl;
+    for (auto setting : {"0", "1"}) {
+        run_with_setting(argv[0], setting, number_nodes.c_str());
+    }
+    return 0;
+}
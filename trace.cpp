@@ -0,0 +1,225 @@
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "config.hpp"
+#include "trace.hpp"
+
+namespace eecs281 {
+
+std::atomic<TraceState> trace_state{TraceState::UNKNOWN};
+
+namespace {
+
+    /**
+     * The part of the ring that a thread is filling in, and the number that
+     * the thread's records are tagged with.  This is trivially constructible
+     * and destructible so that it can be used before the thread has been set
+     * up all the way
+     */
+    struct TraceBuffer {
+        TraceRecord* next;
+        TraceRecord* end;
+        std::uint16_t thread;
+    };
+    thread_local TraceBuffer trace_buffer;
+
+    /**
+     * The mapped trace file and the time that the trace started at, these
+     * are written once before the state becomes ON
+     */
+    TraceHeader* header{nullptr};
+    TraceRecord* records{nullptr};
+    std::int64_t start_time{0};
+
+    /**
+     * The longest path of a trace file, longer paths turn tracing off
+     */
+    constexpr auto MAXIMUM_PATH_LENGTH = 4096;
+
+    /**
+     * The number of threads that have made a traced call
+     */
+    std::atomic<std::uint16_t> number_threads{0};
+
+    /**
+     * Returns the time on the steady clock in nanoseconds
+     */
+    std::int64_t now();
+
+    /**
+     * Writes the path of the trace file of this process into the buffer,
+     * which is the configured path followed by a dot and the process id.
+     * Returns false if the path does not fit
+     */
+    bool trace_file_path(char* buffer, int length);
+
+    /**
+     * Opens and maps the trace file and sets up its header, returns false
+     * if the file cannot be used
+     */
+    bool open_trace();
+
+    /**
+     * Takes the next chunk of records from the ring for the calling thread
+     */
+    void take_chunk();
+
+    /**
+     * The fork handler, a child does not trace
+     */
+    void stop_in_child();
+
+} // namespace <anonymous>
+
+
+void trace(TraceOperation operation, const void* pointer, int size,
+           std::uint64_t argument) {
+    trace_finish(trace_start(size, argument), operation, pointer);
+}
+
+TraceRecord* trace_start(int size, std::uint64_t argument) {
+    auto state = trace_state.load(std::memory_order_acquire);
+    if (state == TraceState::UNKNOWN) {
+
+        // the thread that gets to start the trace opens the file, the calls
+        // that it makes to the allocator while doing so see STARTING and
+        // are not recorded, and neither are those of other threads
+        if (!trace_state.compare_exchange_strong(state,
+                    TraceState::STARTING)) {
+            return nullptr;
+        }
+        auto opened = open_trace();
+        if (opened) {
+            pthread_atfork(nullptr, nullptr, stop_in_child);
+        }
+        trace_state.store(opened ? TraceState::ON : TraceState::OFF,
+                std::memory_order_release);
+        if (!opened) {
+            return nullptr;
+        }
+    } else if (state != TraceState::ON) {
+        return nullptr;
+    }
+
+    auto timestamp = static_cast<std::uint64_t>(now() - start_time);
+    if (trace_buffer.next == trace_buffer.end) {
+        take_chunk();
+    }
+
+    // the operation is written when the record is finished, until then the
+    // record reads as NONE
+    auto record = trace_buffer.next++;
+    record->timestamp = timestamp;
+    record->pointer = 0;
+    record->argument = argument;
+    record->size = static_cast<std::uint32_t>(size);
+    record->thread = trace_buffer.thread;
+    record->operation = TraceOperation::NONE;
+    record->reserved = 0;
+    return record;
+}
+
+void trace_finish(TraceRecord* record, TraceOperation operation,
+                  const void* pointer) {
+    if (record) {
+        record->pointer = reinterpret_cast<std::uintptr_t>(pointer);
+        record->operation = operation;
+    }
+}
+
+namespace {
+
+    std::int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool trace_file_path(char* buffer, int length) {
+        auto path = config().trace_path;
+        auto path_length = static_cast<int>(std::strlen(path));
+
+        // the digits of the process id are written backwards and then
+        // reversed, this is done by hand since it runs inside malloc()
+        char digits[16];
+        auto number_digits = 0;
+        for (auto pid = static_cast<long>(getpid()); pid; pid /= 10) {
+            digits[number_digits++] = static_cast<char>('0' + pid % 10);
+        }
+        if (path_length + 1 + number_digits + 1 > length) {
+            return false;
+        }
+        std::memcpy(buffer, path, path_length);
+        buffer[path_length] = '.';
+        for (auto i = 0; i < number_digits; ++i) {
+            buffer[path_length + 1 + i] = digits[number_digits - 1 - i];
+        }
+        buffer[path_length + 1 + number_digits] = '\0';
+        return true;
+    }
+
+    bool open_trace() {
+        char path[MAXIMUM_PATH_LENGTH];
+        if (!config().trace_path || !trace_file_path(path, sizeof(path))) {
+            return false;
+        }
+
+        auto capacity = (static_cast<std::uint64_t>(config().trace_records)
+                + TRACE_CHUNK - 1) / TRACE_CHUNK * TRACE_CHUNK;
+        auto length = sizeof(TraceHeader) + capacity * sizeof(TraceRecord);
+        auto file = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (file < 0) {
+            return false;
+        }
+        if (ftruncate(file, static_cast<off_t>(length))) {
+            close(file);
+            return false;
+        }
+        auto memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                MAP_SHARED, file, 0);
+        close(file);
+        if (memory == MAP_FAILED) {
+            return false;
+        }
+
+        // the file is all zeros after it is truncated, so every record that
+        // is never written reads as NONE
+        header = static_cast<TraceHeader*>(memory);
+        std::memcpy(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header->version = TRACE_VERSION;
+        header->record_size = sizeof(TraceRecord);
+        header->capacity = capacity;
+        header->cursor.store(0, std::memory_order_relaxed);
+        records = reinterpret_cast<TraceRecord*>(header + 1);
+        start_time = now();
+        return true;
+    }
+
+    void take_chunk() {
+        if (!trace_buffer.thread) {
+            trace_buffer.thread = ++number_threads;
+        }
+
+        // a chunk that is being reused after the ring has wrapped around is
+        // cleared so that the records that the thread does not get to are
+        // not mistaken for its own
+        auto index = header->cursor.fetch_add(TRACE_CHUNK,
+                std::memory_order_relaxed) % header->capacity;
+        trace_buffer.next = records + index;
+        trace_buffer.end = trace_buffer.next + TRACE_CHUNK;
+        std::memset(static_cast<void*>(trace_buffer.next), 0,
+                TRACE_CHUNK * sizeof(TraceRecord));
+    }
+
+    void stop_in_child() {
+        trace_state.store(TraceState::OFF, std::memory_order_relaxed);
+    }
+
+} // namespace <anonymous>
+
+} // namespace eecs281
@@ -0,0 +1,168 @@
+/**
+ * @file trace.hpp
+ * @author Aaryaman Sagar
+ *
+ * This file contains the allocation tracer.  When it is turned on every
+ * call into the allocator is logged as a fixed size binary record to a ring
+ * of records in a file that is mapped into the process, so the log can be
+ * replayed offline against this allocator with other settings or against
+ * other allocators (see trace_replay.cpp).  Every process writes its own
+ * file, named after the configured path with a dot and the id of the
+ * process appended, so the programs that a traced program runs do not
+ * overwrite its trace
+ *
+ *  EECS281_MALLOC_TRACE=/tmp/program.trace ./program
+ *  ./trace_replay /tmp/program.trace.<pid> eecs281
+ *
+ * Writing a record does not lock anything or make a system call.  Threads
+ * take whole chunks of records from the ring with a single atomic add and
+ * fill them in on their own, so the records of a chunk are in the order
+ * that the thread made its calls and the records of different threads are
+ * put in order by their timestamps.  Once the ring is full the oldest
+ * records are overwritten, the file always holds the most recent calls
+ *
+ * A forked child stops tracing, since its records would land in the chunks
+ * of its parent
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace eecs281 {
+
+/**
+ * The calls that are recorded
+ */
+enum class TraceOperation : std::uint8_t {
+    NONE = 0,
+    MALLOC = 1,
+    FREE = 2,
+    CALLOC = 3,
+    REALLOC = 4,
+    ALIGNED_ALLOC = 5,
+};
+
+/**
+ * A recorded call.  The pointer identifies the memory that the call
+ * returned (or freed), addresses are reused so the replay matches a free to
+ * the most recent allocation of the same address
+ */
+struct TraceRecord {
+
+    /**
+     * The time of the call in nanoseconds since the trace started
+     */
+    std::uint64_t timestamp;
+
+    /**
+     * The memory that was allocated or freed
+     */
+    std::uint64_t pointer;
+
+    /**
+     * The memory that a call to realloc() was given or the alignment that
+     * was asked for from aligned_alloc(), 0 for the other calls
+     */
+    std::uint64_t argument;
+
+    /**
+     * The number of bytes that were asked for, this is the total for
+     * calloc() and the size that free_sized() was given for a free
+     */
+    std::uint32_t size;
+
+    /**
+     * The thread that made the call, threads are numbered from 1 in the
+     * order that they made their first call
+     */
+    std::uint16_t thread;
+
+    TraceOperation operation;
+    std::uint8_t reserved;
+};
+static_assert(sizeof(TraceRecord) == 32, "Trace records should stay compact");
+
+/**
+ * The header at the start of a trace file, the records follow it.  The
+ * cursor is the number of records that have been handed out to threads
+ * since the trace started, the record at index i is at position
+ * i % capacity of the ring
+ */
+struct TraceHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t record_size;
+    std::uint64_t capacity;
+    alignas(64) std::atomic<std::uint64_t> cursor;
+    char padding[56];
+};
+static_assert(sizeof(TraceHeader) == 128, "The records start at 128 bytes");
+
+/**
+ * The magic string and the version of the format of trace files
+ */
+constexpr char TRACE_MAGIC[8] = {'E', '2', '8', '1', 'T', 'R', 'C', '\0'};
+constexpr std::uint32_t TRACE_VERSION = 1;
+
+/**
+ * The number of records that a thread takes from the ring at once, the
+ * capacity of the ring is a multiple of this
+ */
+constexpr auto TRACE_CHUNK = 256;
+
+/**
+ * Whether calls are traced, the state starts out as UNKNOWN and is settled
+ * by the first call that is traced.  Anything other than OFF makes the
+ * allocator call trace()
+ */
+enum class TraceState { UNKNOWN, STARTING, OFF, ON };
+extern std::atomic<TraceState> trace_state;
+
+/**
+ * Returns true if the call that is being made might have to be traced, this
+ * is all that tracing costs when it is off
+ */
+inline bool trace_enabled() {
+    return trace_state.load(std::memory_order_relaxed) != TraceState::OFF;
+}
+
+/**
+ * Records a call made by the calling thread.  The first call opens the
+ * trace file if one is set in the configuration (see config.hpp) and turns
+ * tracing off for good otherwise, calls that are made while the file is
+ * being opened are not recorded
+ *
+ * @param operation the call that was made
+ * @param pointer the memory that the call returned or freed
+ * @param size the number of bytes that were asked for
+ * @param argument the memory given to realloc() or the alignment given to
+ *        aligned_alloc()
+ */
+void trace(TraceOperation operation, const void* pointer, int size,
+           std::uint64_t argument = 0);
+
+/**
+ * Records a call in two steps, for a call that frees memory before the
+ * memory that it returns is known.  trace_start() takes the calling
+ * thread's next record and stamps it with the time before the call is
+ * made, so that it comes before any allocation of the freed memory by
+ * another thread, and trace_finish() fills in the memory that the call
+ * returned.  A record that is never finished (because the call threw) is
+ * skipped by the replay
+ *
+ * @param size the number of bytes that were asked for
+ * @param argument the memory given to realloc() or the alignment given to
+ *        aligned_alloc()
+ * @param record the record returned by trace_start()
+ * @param operation the call that was made
+ * @param pointer the memory that the call returned
+ *
+ * @return the record, or a nullptr if the call is not recorded
+ */
+TraceRecord* trace_start(int size, std::uint64_t argument = 0);
+void trace_finish(TraceRecord* record, TraceOperation operation,
+                  const void* pointer);
+
+} // namespace eecs281
@@ -0,0 +1,432 @@
+/**
+ * @file trace_replay.cpp
+ * @author Aaryaman Sagar
+ *
+ * Replays a trace that was recorded with EECS281_MALLOC_TRACE (see
+ * trace.hpp) against this allocator and against the system's malloc(3), and
+ * reports how long the calls took, the peak number of bytes that the trace
+ * had live, the peak resident memory that the replay added to the process
+ * and the fragmentation ratio, which is the peak resident memory divided by
+ * the peak live bytes.  The system allocator is whatever malloc(3) the tool
+ * is linked with, so other allocators can be compared by preloading them
+ *
+ *  LD_PRELOAD=/usr/lib/libjemalloc.so ./trace_replay program.trace system
+ *
+ * The records of all the threads are replayed in the order of their
+ * timestamps on a single thread, so the replay reproduces the sizes and the
+ * lifetimes of the allocations but not the contention between threads.
+ * Before anything is timed the records are resolved to a list of steps on
+ * numbered slots, so the replay itself does no bookkeeping other than
+ * counting the live bytes.  A free of memory that the trace did not see
+ * being allocated (because it was allocated before the trace started or
+ * its record was overwritten in the ring) is skipped, as is an allocation
+ * of memory that the trace still has live, these are counted as unmatched
+ *
+ * Since the peak resident memory is per process the tool runs itself once
+ * for every allocator unless one is given.  Build and run with
+ *
+ *  make trace_replay
+ *  ./trace_replay <trace file> [eecs281 or system]
+ */
+
+#include <cstdint>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "eecs281malloc.hpp"
+#include "trace.hpp"
+
+using eecs281::TraceOperation;
+using eecs281::TraceRecord;
+
+namespace {
+
+    /**
+     * The flag that tells the tool that it has been run by itself to replay
+     * the trace with one allocator
+     */
+    constexpr auto RUN_FLAG = "--run";
+
+    /**
+     * Adapters so that the trace can be replayed with either allocator
+     */
+    struct Eecs281Allocator {
+        static void* allocate(int amount) { return eecs281::malloc(amount); }
+        static void* allocate_cleared(int amount) {
+            return eecs281::calloc(amount, 1);
+        }
+        static void* allocate_aligned(int alignment, int amount) {
+            return eecs281::aligned_alloc(alignment, amount);
+        }
+        static void* reallocate(void* pointer, int amount) {
+            return eecs281::realloc(pointer, amount);
+        }
+        static void deallocate(void* pointer) { eecs281::free(pointer); }
+    };
+    struct SystemAllocator {
+        static void* allocate(int amount) { return std::malloc(amount); }
+        static void* allocate_cleared(int amount) {
+            return std::calloc(amount, 1);
+        }
+        static void* allocate_aligned(int alignment, int amount) {
+            auto pointer = static_cast<void*>(nullptr);
+            return posix_memalign(&pointer, std::max(alignment,
+                        static_cast<int>(sizeof(void*))), amount)
+                ? nullptr : pointer;
+        }
+        static void* reallocate(void* pointer, int amount) {
+            return std::realloc(pointer, amount);
+        }
+        static void deallocate(void* pointer) { std::free(pointer); }
+    };
+
+    /**
+     * A call to replay, the memory of every allocation goes into a slot of
+     * its own.  An allocation fills the target slot, a free empties the
+     * source slot and a realloc moves the memory from the source slot to the
+     * target slot
+     */
+    struct Step {
+        TraceOperation operation;
+        int size;
+        int alignment;
+        int source;
+        int target;
+    };
+
+    /**
+     * The steps of a trace and the numbers that describe it
+     */
+    struct Replay {
+        std::vector<Step> steps;
+        int number_slots{0};
+        int number_threads{0};
+        std::uint64_t number_records{0};
+        std::uint64_t unmatched{0};
+    };
+
+    /**
+     * Reads the records out of a trace file and puts them in the order of
+     * their timestamps, exits with a message if the file is not a trace
+     */
+    std::vector<TraceRecord> read_trace(const char* path);
+
+    /**
+     * Resolves the records to steps on numbered slots
+     */
+    Replay resolve(const std::vector<TraceRecord>& records);
+
+    /**
+     * Replays the steps with the allocator and prints a row of results
+     */
+    template <typename Allocator>
+    void replay(const Replay& resolved, const char* name);
+
+    /**
+     * Resets the peak resident memory of the process to its current
+     * resident memory, so that the memory used to read the trace does not
+     * count, and returns the current resident memory in bytes
+     */
+    std::int64_t reset_peak_resident();
+
+    /**
+     * Returns the peak resident memory of the process in bytes
+     */
+    std::int64_t peak_resident_bytes();
+
+    /**
+     * Returns the value of a field of /proc/self/status in bytes
+     */
+    std::int64_t read_status(const char* field);
+
+} // namespace <anonymous>
+
+
+int main(int argc, char** argv) {
+    if (argc < 2 || (argc > 2 && std::strcmp(argv[1], RUN_FLAG)
+                && std::strcmp(argv[2], "eecs281")
+                && std::strcmp(argv[2], "system"))) {
+        std::cerr << "usage: " << argv[0]
+                  << " <trace file> [eecs281 or system]" << std::endl;
+        return 1;
+    }
+
+    if (argc > 3 && !std::strcmp(argv[1], RUN_FLAG)) {
+        auto resolved = resolve(read_trace(argv[2]));
+        if (!std::strcmp(argv[3], "system")) {
+            replay<SystemAllocator>(resolved, "system");
+        } else {
+            replay<Eecs281Allocator>(resolved, "eecs281");
+        }
+        return 0;
+    }
+
+    // validate the trace once up front rather than in every child
+    auto resolved = resolve(read_trace(argv[1]));
+    std::cout << resolved.number_records << " records from "
+              << resolved.number_threads << " threads, " << resolved.unmatched
+              << " unmatched" << std::endl;
+    std::cout << std::left << std::setw(9) << "malloc" << std::right
+              << std::setw(12) << "calls" << std::setw(10) << "seconds"
+              << std::setw(10) << "Mops/s" << std::setw(12) << "live MiB"
+              << std::setw(12) << "peak MiB" << std::setw(8) << "frag"
+              << std::endl;
+
+    auto allocators = std::vector<const char*>{"eecs281", "system"};
+    if (argc > 2) {
+        allocators = {argv[2]};
+    }
+    for (auto allocator : allocators) {
+        auto child = fork();
+        if (child < 0) {
+            std::perror("fork");
+            return 1;
+        }
+        if (!child) {
+            char* arguments[] = {argv[0], const_cast<char*>(RUN_FLAG),
+                argv[1], const_cast<char*>(allocator), nullptr};
+            execv("/proc/self/exe", arguments);
+            std::perror("execv");
+            std::_Exit(1);
+        }
+        auto status = 0;
+        waitpid(child, &status, 0);
+    }
+    return 0;
+}
+
+namespace {
+
+    std::vector<TraceRecord> read_trace(const char* path) {
+        auto fail = [path](const char* message) {
+            std::cerr << path << ": " << message << std::endl;
+            std::exit(1);
+        };
+
+        auto file = open(path, O_RDONLY | O_CLOEXEC);
+        if (file < 0) {
+            fail(std::strerror(errno));
+        }
+        auto header = eecs281::TraceHeader{};
+        if (pread(file, &header, sizeof(header), 0)
+                != static_cast<ssize_t>(sizeof(header))
+                || std::memcmp(header.magic, eecs281::TRACE_MAGIC,
+                    sizeof(eecs281::TRACE_MAGIC))
+                || header.version != eecs281::TRACE_VERSION
+                || header.record_size != sizeof(TraceRecord)
+                || !header.capacity) {
+            fail("not a trace file");
+        }
+
+        // every position of the ring that has been handed out holds
+        // records, the ones that a thread never got to are NONE
+        auto number = std::min(header.cursor.load(), header.capacity);
+        auto records = std::vector<TraceRecord>(number);
+        auto length = static_cast<ssize_t>(number * sizeof(TraceRecord));
+        if (pread(file, records.data(), length, sizeof(header)) != length) {
+            fail("the trace file is truncated");
+        }
+        close(file);
+
+        records.erase(std::remove_if(records.begin(), records.end(),
+                    [](const TraceRecord& record) {
+                        return record.operation == TraceOperation::NONE
+                            || record.operation
+                                > TraceOperation::ALIGNED_ALLOC;
+                    }), records.end());
+        std::stable_sort(records.begin(), records.end(),
+                [](const TraceRecord& one, const TraceRecord& two) {
+                    return one.timestamp < two.timestamp;
+                });
+        return records;
+    }
+
+    Replay resolve(const std::vector<TraceRecord>& records) {
+        auto result = Replay{};
+        result.number_records = records.size();
+        result.steps.reserve(records.size());
+
+        // the slot that holds the memory at each live address
+        auto live = std::unordered_map<std::uint64_t, int>{};
+        live.reserve(records.size());
+        auto take = [&](std::uint64_t address) {
+            auto slot = live.find(address);
+            if (slot == live.end()) {
+                return -1;
+            }
+            auto index = slot->second;
+            live.erase(slot);
+            return index;
+        };
+        auto fill = [&](std::uint64_t address) {
+            if (live.count(address)) {
+                ++result.unmatched;
+                return -1;
+            }
+            live[address] = result.number_slots;
+            return result.number_slots++;
+        };
+
+        for (const auto& record : records) {
+            result.number_threads = std::max(result.number_threads,
+                    static_cast<int>(record.thread));
+            auto size = static_cast<int>(std::max(record.size, 1u));
+            auto step = Step{record.operation, size, 0, -1, -1};
+
+            switch (record.operation) {
+            case TraceOperation::FREE:
+                step.source = take(record.pointer);
+                if (step.source < 0) {
+                    ++result.unmatched;
+                    continue;
+                }
+                break;
+
+            case TraceOperation::REALLOC:
+                // a realloc of nothing is a malloc and a realloc to nothing
+                // is a free
+                step.source = record.argument ? take(record.argument) : -1;
+                if (!record.pointer) {
+                    step.operation = TraceOperation::FREE;
+                    if (step.source < 0) {
+                        ++result.unmatched;
+                        continue;
+                    }
+                    break;
+                }
+                if (step.source < 0) {
+                    result.unmatched += (record.argument != 0);
+                    step.operation = TraceOperation::MALLOC;
+                }
+                step.target = fill(record.pointer);
+                if (step.target < 0) {
+                    if (step.source < 0) {
+                        continue;
+                    }
+                    step.operation = TraceOperation::FREE;
+                }
+                break;
+
+            case TraceOperation::ALIGNED_ALLOC:
+                step.alignment = static_cast<int>(record.argument);
+                step.target = fill(record.pointer);
+                if (step.target < 0) {
+                    continue;
+                }
+                break;
+
+            default:
+                step.target = fill(record.pointer);
+                if (step.target < 0) {
+                    continue;
+                }
+                break;
+            }
+            result.steps.push_back(step);
+        }
+        return result;
+    }
+
+    template <typename Allocator>
+    void replay(const Replay& resolved, const char* name) {
+        auto slots = std::vector<void*>(resolved.number_slots);
+        auto sizes = std::vector<int>(resolved.number_slots);
+        auto live_bytes = std::int64_t{0};
+        auto peak_live = std::int64_t{0};
+        auto resident_before = reset_peak_resident();
+
+        auto start = std::chrono::steady_clock::now();
+        for (const auto& step : resolved.steps) {
+            switch (step.operation) {
+            case TraceOperation::FREE:
+                Allocator::deallocate(slots[step.source]);
+                slots[step.source] = nullptr;
+                live_bytes -= sizes[step.source];
+                continue;
+            case TraceOperation::MALLOC:
+                slots[step.target] = Allocator::allocate(step.size);
+                break;
+            case TraceOperation::CALLOC:
+                slots[step.target] = Allocator::allocate_cleared(step.size);
+                break;
+            case TraceOperation::ALIGNED_ALLOC:
+                slots[step.target] = Allocator::allocate_aligned(
+                        step.alignment, step.size);
+                break;
+            case TraceOperation::REALLOC:
+                slots[step.target] = Allocator::reallocate(
+                        slots[step.source], step.size);
+                slots[step.source] = nullptr;
+                live_bytes -= sizes[step.source];
+                break;
+            case TraceOperation::NONE:
+                continue;
+            }
+            *static_cast<char*>(slots[step.target]) = 1;
+            sizes[step.target] = step.size;
+            live_bytes += step.size;
+            peak_live = std::max(peak_live, live_bytes);
+        }
+        auto elapsed = std::chrono::duration<double>{
+            std::chrono::steady_clock::now() - start};
+        auto peak_resident = peak_resident_bytes() - resident_before;
+
+        for (auto pointer : slots) {
+            if (pointer) {
+                Allocator::deallocate(pointer);
+            }
+        }
+
+        std::cout << std::left << std::setw(9) << name << std::right
+                  << std::setw(12) << resolved.steps.size()
+                  << std::setw(10) << std::fixed << std::setprecision(3)
+                  << elapsed.count()
+                  << std::setw(10) << std::setprecision(2)
+                  << resolved.steps.size() / elapsed.count() / 1e6
+                  << std::setw(12) << std::setprecision(1)
+                  << peak_live / 1048576.0
+                  << std::setw(12) << peak_resident / 1048576.0
+                  << std::setw(8) << std::setprecision(2)
+                  << (peak_live ? static_cast<double>(peak_resident)
+                          / static_cast<double>(peak_live) : 0.0)
+                  << std::endl;
+    }
+
+    std::int64_t reset_peak_resident() {
+        auto file = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+        if (file >= 0) {
+            static_cast<void>(write(file, "5", 1));
+            close(file);
+        }
+        return read_status("VmRSS:");
+    }
+
+    std::int64_t peak_resident_bytes() {
+        return read_status("VmHWM:");
+    }
+
+    std::int64_t read_status(const char* field) {
+        auto status = std::ifstream{"/proc/self/status"};
+        auto line = std::string{};
+        while (std::getline(status, line)) {
+            if (!line.compare(0, std::strlen(field), field)) {
+                return std::atoll(line.c_str() + std::strlen(field)) * 1024;
+            }
+        }
+        return 0;
+    }
+
+} // namespace <anonymous>